@@ -2,6 +2,9 @@
 #include <string>
 #include <cstdio>
 #include <cassert>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
 
 #include "Grid.h"
 
@@ -126,7 +129,7 @@ int Block::voxel( const Gridpoint& p ) const
     if(id < 0)
         return -1;      // ou 0 ??
     
-    return (int) data[id];
+    return value(id);
 }
 
 int Block::voxel( const Gridindex& i ) const
@@ -135,18 +138,512 @@ int Block::voxel( const Gridindex& i ) const
     if(id < 0)
         return -1;      // ou 0 ??
     
-    return (int) data[id];
+    return value(id);
+}
+
+void Block::set( const int id, const unsigned char v )
+{
+    assert(id >= 0 && id < 4096);
+    if(bits_per_voxel > 0)
+    {
+        // la valeur est deja dans la palette, modifie l'indice
+        for(unsigned int i= 0; i < palette.size(); i++)
+            if(palette[i] == v)
+            {
+                const unsigned int offset= (unsigned int) id * bits_per_voxel;
+                const unsigned int mask= (1u << bits_per_voxel) -1u;
+                bits[offset >> 5]= (bits[offset >> 5] & ~(mask << (offset & 31u))) | (i << (offset & 31u));
+                
+                // met a jour l'occupation
+                if(occupied(id) != (v != 0))
+                {
+                    unsigned long long words[64];
+                    if(fill == MIXED)
+                        memcpy(words, &occupancy.front(), sizeof(words));
+                    else
+                        memset(words, (fill == SOLID) ? 0xFF : 0, sizeof(words));
+                    
+                    words[id >> 6]^= 1ull << (id & 63);
+                    summarize(words);
+                }
+                
+                // la pyramide n'est plus a jour
+                std::vector<unsigned char>().swap(mips);
+                return;
+            }
+    }
+    else if(palette[0] == v)
+        return;
+    
+    // nouvelle valeur, reconstruit la palette
+    unsigned char voxels[4096];
+    decompress(voxels);
+    voxels[id]= v;
+    compress(voxels);
+}
+
+void Block::compress( const unsigned char *voxels )
+{
+    assert(voxels != NULL);
+    
+    // construit la palette, dans l'ordre d'apparition des valeurs
+    int remap[256];
+    for(int i= 0; i < 256; i++)
+        remap[i]= -1;
+    
+    palette.clear();
+    for(int i= 0; i < 4096; i++)
+        if(remap[voxels[i]] < 0)
+        {
+            remap[voxels[i]]= (int) palette.size();
+            palette.push_back(voxels[i]);
+        }
+    
+    // libere la memoire inutilisee
+    std::vector<unsigned char>(palette).swap(palette);
+    std::vector<unsigned char>().swap(mips);
+    
+    // occupation des voxels
+    summarize(voxels);
+    
+    if(palette.size() == 1)
+    {
+        // block uniforme, pas d'indices
+        bits_per_voxel= 0;
+        std::vector<unsigned int>().swap(bits);
+        return;
+    }
+    
+    // nombre de bits par indice, une puissance de 2 : un indice n'est jamais stocke a cheval sur 2 mots
+    bits_per_voxel= 1;
+    while((1u << bits_per_voxel) < palette.size())
+        bits_per_voxel*= 2;
+    
+    std::vector<unsigned int>(4096 * bits_per_voxel / 32, 0u).swap(bits);
+    for(int i= 0; i < 4096; i++)
+    {
+        const unsigned int offset= (unsigned int) i * bits_per_voxel;
+        bits[offset >> 5]|= (unsigned int) remap[voxels[i]] << (offset & 31u);
+    }
+}
+
+void Block::summarize( const unsigned char *voxels )
+{
+    unsigned long long words[64];
+    memset(words, 0, sizeof(words));
+    for(int i= 0; i < 4096; i++)
+        if(voxels[i] != 0)
+            words[i >> 6]|= 1ull << (i & 63);
+    
+    summarize(words);
+}
+
+void Block::summarize( const unsigned long long *words )
+{
+    bool empty= true;
+    bool solid= true;
+    for(int i= 0; i < 64; i++)
+    {
+        if(words[i] != 0)
+            empty= false;
+        if(words[i] != ~0ull)
+            solid= false;
+    }
+    
+    if(empty || solid)
+    {
+        fill= empty ? EMPTY : SOLID;
+        std::vector<unsigned long long>().swap(occupancy);
+    }
+    else
+    {
+        fill= MIXED;
+        occupancy.assign(words, words + 64);
+    }
+}
+
+bool Block::face_full( const int face ) const
+{
+    assert(face >= 0 && face < 6);
+    if(fill != MIXED)
+        return (fill == SOLID);
+    
+    // 1 ligne de 16 voxels (axe z) = 16 bits, 4 lignes (x) par mot, 4 mots par tranche y
+    const int axis= face / 2;
+    const bool last= (face & 1) != 0;
+    for(int i= 0; i < 64; i++)
+    {
+        unsigned long long mask= 0;
+        if(axis == 0 && (i & 3) == (last ? 3 : 0))
+            mask= last ? 0xFFFF000000000000ull : 0x000000000000FFFFull;
+        else if(axis == 1 && (i >> 2) == (last ? 15 : 0))
+            mask= ~0ull;
+        else if(axis == 2)
+            mask= last ? 0x8000800080008000ull : 0x0001000100010001ull;
+        
+        if((occupancy[i] & mask) != mask)
+            return false;
+    }
+    
+    return true;
+}
+
+void Block::decompress( unsigned char *voxels ) const
+{
+    assert(voxels != NULL);
+    if(bits_per_voxel == 0)
+    {
+        memset(voxels, palette[0], 4096);
+        return;
+    }
+    
+    for(int i= 0; i < 4096; i++)
+        voxels[i]= (unsigned char) value(i);
+}
+
+
+// niveaux de detail
+// reduit une grille n^3 en grille (n/2)^3, ordre Grid::index() : chaque cellule prend la valeur non vide la plus frequente de ses 8 filles.
+static
+void downsample( const unsigned char *voxels, const int n, unsigned char *mip )
+{
+    const int m= n / 2;
+    for(int y= 0; y < m; y++)
+    for(int x= 0; x < m; x++)
+    for(int z= 0; z < m; z++)
+    {
+        unsigned char values[8];
+        int count= 0;
+        for(int i= 0; i < 8; i++)
+        {
+            const unsigned char v= voxels[((2*y + (i >> 2)) * n + 2*x + ((i >> 1) & 1)) * n + 2*z + (i & 1)];
+            if(v != 0)
+                values[count++]= v;
+        }
+        
+        // valeur la plus frequente, la plus petite en cas d'egalite
+        unsigned char value= 0;
+        int best= 0;
+        for(int i= 0; i < count; i++)
+        {
+            int k= 0;
+            for(int j= 0; j < count; j++)
+                if(values[j] == values[i])
+                    k++;
+            
+            if(k > best || (k == best && values[i] < value))
+            {
+                value= values[i];
+                best= k;
+            }
+        }
+        
+        mip[(y * m + x) * m + z]= value;
+    }
+}
+
+void Block::build_mips( )
+{
+    if(mips.empty() == false)
+        return;
+    
+    mips.resize(512+64+8+1);
+    if(bits_per_voxel == 0)
+    {
+        // block uniforme
+        memset(&mips.front(), palette[0], mips.size());
+        return;
+    }
+    
+    unsigned char voxels[4096];
+    decompress(voxels);
+    
+    unsigned char *mip= &mips.front();
+    downsample(voxels, 16, mip);
+    downsample(mip, 8, mip + 512);
+    downsample(mip + 512, 4, mip + 512+64);
+    downsample(mip + 512+64, 2, mip + 512+64+8);
+}
+
+const unsigned char *Region::lod_block( const Gridpoint& p, const int level )
+{
+    assert(level >= 1 && level <= 4);
+    Block *b= block(p);
+    if(b == NULL)
+        return NULL;
+    
+    b->build_mips();
+    return b->mip(level);
+}
+
+int Region::lod_voxel( const Gridpoint& p, const int level )
+{
+    assert(level >= 0 && level <= 4);
+    if(bbox.inside(p) == false)
+        return -1;
+    
+    Block *b= block(p);
+    if(b == NULL)
+        return 0;
+    if(level == 0)
+        return b->value((p.y & 15) * 256 + (p.x & 15) * 16 + (p.z & 15));
+    
+    b->build_mips();
+    const int n= 16 >> level;
+    const int x= (p.x & 15) >> level;
+    const int y= (p.y & 15) >> level;
+    const int z= (p.z & 15) >> level;
+    return b->mip(level)[(y * n + x) * n + z];
+}
+
+void Region::build_lods( )
+{
+    const int n= (int) data.size();
+    #pragma omp parallel for schedule(dynamic, 16)
+    for(int i= 0; i < n; i++)
+        data[i].build_mips();
+}
+
+
+int World::voxels( const Gridpoint *points, const int n, int *values, GridCache& cache ) const
+{
+    int count= 0;
+    for(int i= 0; i < n; i++)
+    {
+        values[i]= voxel(points[i], cache);
+        if(values[i] >= 0)
+            count++;
+    }
+    
+    return count;
+}
+
+
+// lancer de rayons
+// renvoie la taille de la cellule vide contenant le voxel : 4096 (map absente), 256 (region absente), 16 (block absent ou vide),
+// ou 1 si le voxel appartient a un block non vide.
+static
+int empty_cell( const World& world, const int key, const Block *& block )
+{
+    const unsigned int bx= (unsigned int) key >> 16;
+    const unsigned int by= ((unsigned int) key >> 12) & 15u;
+    const unsigned int bz= (unsigned int) key & 4095u;
+    
+    block= NULL;
+    const int m= world.maps[(bx >> 8) * 16u + (bz >> 8)];
+    if(m < 0)
+        return 4096;
+    const Map& map= world.data[m];
+    
+    const int r= map.regions[((bx >> 4) & 15u) * 16u + ((bz >> 4) & 15u)];
+    if(r < 0)
+        return 256;
+    const Region& region= map.data[r];
+    
+    const int b= region.blocks[by * 256u + (bx & 15u) * 16u + (bz & 15u)];
+    if(b < 0)
+        return 16;
+    
+    block= &region.data[b];
+    if(block->empty())
+        return 16;
+    return 1;
+}
+
+bool World::intersect( const gk::Vec3& origin, const gk::Vec3& direction, const float tmax, GridHit& hit ) const
+{
+    const float o[3]= { origin.x, origin.y, origin.z };
+    const float d[3]= { direction.x, direction.y, direction.z };
+    const int wmin[3]= { bbox.pMin.x, bbox.pMin.y, bbox.pMin.z };
+    const int wmax[3]= { bbox.pMax.x, bbox.pMax.y, bbox.pMax.z };
+    
+    // intersection avec la boite englobante du monde
+    float tnear= 0;
+    float tfar= tmax;
+    int axis= -1;       // axe de la derniere face traversee
+    for(int a= 0; a < 3; a++)
+    {
+        if(d[a] == 0)
+        {
+            if(o[a] < wmin[a] || o[a] >= wmax[a] +1)
+                return false;
+            continue;
+        }
+        
+        float t0= (wmin[a] - o[a]) / d[a];
+        float t1= (wmax[a] +1 - o[a]) / d[a];
+        if(t0 > t1)
+            std::swap(t0, t1);
+        if(t0 > tnear)
+        {
+            tnear= t0;
+            axis= a;
+        }
+        tfar= std::min(tfar, t1);
+    }
+    if(tnear > tfar)
+        return false;
+    
+    // voxel d'entree dans le monde
+    int cell[3];
+    for(int a= 0; a < 3; a++)
+        cell[a]= std::min(wmax[a], std::max(wmin[a], (int) floorf(o[a] + tnear * d[a])));
+    if(axis >= 0)
+        // evite les erreurs d'arrondi sur la face d'entree
+        cell[axis]= (d[axis] > 0) ? wmin[axis] : wmax[axis];
+    
+    int step[3];
+    float delta[3];
+    for(int a= 0; a < 3; a++)
+    {
+        step[a]= (d[a] > 0) ? 1 : ((d[a] < 0) ? -1 : 0);
+        delta[a]= (d[a] != 0) ? fabsf(1 / d[a]) : HUGE_VALF;
+    }
+    
+    float t= tnear;
+    for(;;)
+    {
+        const int key= block_key(Gridpoint(cell[0], cell[1], cell[2]));
+        if(key < 0)
+            return false;       // sortie du monde
+        
+        const Block *block;
+        const int size= empty_cell(*this, key, block);
+        if(size > 1)
+        {
+            // traverse la cellule vide en 1 pas
+            int lo[3];
+            float texit= HUGE_VALF;
+            int exit= -1;
+            for(int a= 0; a < 3; a++)
+            {
+                lo[a]= cell[a] & ~(size -1);
+                if(step[a] == 0)
+                    continue;
+                
+                float ta= ((step[a] > 0 ? lo[a] + size : lo[a]) - o[a]) / d[a];
+                if(ta < texit)
+                {
+                    texit= ta;
+                    exit= a;
+                }
+            }
+            
+            if(exit < 0 || texit > tfar)
+                return false;
+            
+            t= std::max(t, texit);
+            axis= exit;
+            for(int a= 0; a < 3; a++)
+                if(a != exit)
+                    cell[a]= std::min(lo[a] + size -1, std::max(lo[a], (int) floorf(o[a] + t * d[a])));
+            cell[exit]= (step[exit] > 0) ? lo[exit] + size : lo[exit] -1;
+            continue;
+        }
+        
+        // parcours les voxels du block
+        float next[3];
+        for(int a= 0; a < 3; a++)
+            next[a]= (step[a] != 0) ? ((step[a] > 0 ? cell[a] +1 : cell[a]) - o[a]) / d[a] : HUGE_VALF;
+        
+        const int bmin[3]= { cell[0] & ~15, cell[1] & ~15, cell[2] & ~15 };
+        for(;;)
+        {
+            // teste l'occupation du voxel, ne decode la valeur qu'en cas d'intersection
+            const int id= (cell[1] & 15) * 256 + (cell[0] & 15) * 16 + (cell[2] & 15);
+            if(block->occupied(id))
+            {
+                const int v= block->value(id);
+                hit.voxel= Gridpoint(cell[0], cell[1], cell[2]);
+                hit.normal= Gridindex();
+                if(axis >= 0)
+                    hit.normal[axis]= -step[axis];
+                hit.t= t;
+                hit.value= v;
+                return true;
+            }
+            
+            // voxel suivant
+            int a= 0;
+            if(next[1] < next[a]) a= 1;
+            if(next[2] < next[a]) a= 2;
+            
+            t= next[a];
+            if(t > tfar)
+                return false;
+            
+            axis= a;
+            cell[a]+= step[a];
+            next[a]+= delta[a];
+            if(cell[a] < bmin[a] || cell[a] > bmin[a] + 15)
+                break;  // sortie du block
+        }
+    }
+}
+
+
+// modification des voxels
+int World::set( const Gridpoint& p, const unsigned char v )
+{
+    const int key= block_key(p);
+    if(key < 0)
+        return -1;
+    
+    Block *b= find_block(key);
+    if(b == NULL)
+    {
+        if(v == 0)
+            return 0;   // pas de block, que de l'air, rien a faire
+        
+        // cree un nouveau block vide
+        Gridpoint bmin(p.x & ~15, p.y & ~15, p.z & ~15);
+        Gridpoint bmax(bmin.x + 15, bmin.y + 15, bmin.z + 15);
+        if(insert( Block(Gridbox(bmin, bmax)) ) < 0)
+            return -1;
+        
+        b= find_block(key);
+        assert(b != NULL);
+    }
+    
+    const int x= p.x & 15;
+    const int y= p.y & 15;
+    const int z= p.z & 15;
+    b->set(y * 256 + x * 16 + z, v);
+    
+    // marque le block et les voisins qui partagent une face avec le voxel
+    const Gridpoint neighbours[7]= 
+    {
+        p,
+        Gridpoint(p.x -1, p.y, p.z), Gridpoint(p.x +1, p.y, p.z),
+        Gridpoint(p.x, p.y -1, p.z), Gridpoint(p.x, p.y +1, p.z),
+        Gridpoint(p.x, p.y, p.z -1), Gridpoint(p.x, p.y, p.z +1)
+    };
+    const bool border[7]= { true, x == 0, x == 15, y == 0, y == 15, z == 0, z == 15 };
+    
+    for(int i= 0; i < 7; i++)
+    {
+        if(border[i] == false)
+            continue;
+        
+        const int nkey= block_key(neighbours[i]);
+        Block *n= (nkey < 0) ? NULL : find_block(nkey);
+        if(n == NULL || n->dirty)
+            continue;
+        
+        n->dirty= true;
+        dirty.push_back(nkey);
+    }
+    
+    return 0;
 }
 
 
 // construction du hachage spatial
-int World::insert( const Block& block )
+Map *World::create_map( const Gridpoint& p )
 {
-    // inserer le bloc dans le monde
-    Gridpoint p(block.bbox.pMin);
     int id= index(p);
     if(id < 0)
-        return -1;
+        return NULL;
     
     if(maps[id] < 0)
     {
@@ -157,11 +654,21 @@ int World::insert( const Block& block )
         
         Gridbox mbox(mmin, mmax);
         assert(mbox.inside(p));
-        maps[id]= (short) data.size();
-        data.push_back( Map(mbox) );
+        maps[id]= (int) data.push_back( Map(mbox) );
+        revision++;
     }
     
-    Map *m= &data[maps[id]];
+    return &data[maps[id]];
+}
+
+int World::insert( const Block& block )
+{
+    // inserer le bloc dans le monde
+    Gridpoint p(block.bbox.pMin);
+    Map *m= create_map(p);
+    if(m == NULL)
+        return -1;
+    
     // inserer le bloc dans la map
     int mid= m->index(p);
     if(mid < 0)
@@ -176,8 +683,7 @@ int World::insert( const Block& block )
         
         Gridbox rbox(rmin, rmax);
         assert(rbox.inside(p));
-        m->regions[mid]= (short) m->data.size();
-        m->data.push_back( Region(rbox) );
+        m->regions[mid]= (int) m->data.push_back( Region(rbox) );
     }
     
     Region *r= &m->data[m->regions[mid]];
@@ -198,8 +704,8 @@ int World::insert( const Block& block )
         assert(bbox == block.bbox);
         
         // inserer le nouveau block
-        r->blocks[rid]= (short) r->data.size();
-        r->data.push_back( block );
+        r->blocks[rid]= (int) r->data.push_back( block );
+        revision++;
         return 0;
     }
     
@@ -207,6 +713,84 @@ int World::insert( const Block& block )
     return -1;
 }
 
+int World::insert( Region& region )
+{
+    // inserer la region dans le monde
+    Gridpoint p(region.bbox.pMin);
+    Map *m= create_map(p);
+    if(m == NULL)
+        return -1;
+    
+    // inserer la region dans la map
+    int mid= m->index(p);
+    if(mid < 0)
+        return -1;
+    if(m->regions[mid] >= 0)
+        // la region existe deja...
+        return -1;
+    
+    // verifier les bbox
+    Gridindex index= m->grid_index(p);
+    Gridpoint rmin( m->grid_point(index) );
+    Gridpoint rmax( rmin.x + m->scale.x -1, rmin.y + m->scale.y -1, rmin.z + m->scale.z -1 );
+    assert(Gridbox(rmin, rmax) == region.bbox);
+    
+    // transfere les donnees de la region, sans copier les blocks
+    m->regions[mid]= (int) m->data.push_back( Region() );
+    m->data.back().swap(region);
+    revision++;
+    return 0;
+}
+
+int World::remove( const Gridpoint& p )
+{
+    Map *m= map(p);
+    if(m == NULL)
+        return -1;
+    int mid= m->index(p);
+    if(mid < 0 || m->regions[mid] < 0)
+        return -1;
+    
+    // deplace la derniere region dans la place libre, et met a jour son index
+    int id= m->regions[mid];
+    int last= (int) m->data.size() -1;
+    if(id != last)
+    {
+        m->data[id].swap(m->data[last]);
+        for(unsigned int i= 0; i < m->regions.size(); i++)
+            if(m->regions[i] == last)
+            {
+                m->regions[i]= id;
+                break;
+            }
+    }
+    
+    m->regions[mid]= -1;
+    m->data.pop_back();
+    revision++;
+    return 0;
+}
+
+
+// gestion des regions
+void Region::swap( Region& b )
+{
+    std::swap(size, b.size);
+    std::swap(scale, b.scale);
+    std::swap(bbox, b.bbox);
+    blocks.swap(b.blocks);
+    data.swap(b.data);
+}
+
+size_t Region::memory( ) const
+{
+    size_t length= sizeof(Region) + blocks.capacity() * sizeof(int) + (data.capacity() - data.size()) * sizeof(Block);
+    for(unsigned int i= 0; i < data.size(); i++)
+        length+= data[i].memory();
+    
+    return length;
+}
+
 
 // chargement des donnees
 int World::loadMap( const std::string& pathname )
@@ -221,84 +805,480 @@ int World::loadMap( const std::string& pathname )
         return -1;
     }
     
-    bool error= true;
+    std::vector<std::string> filenames;
     char tmp[1024];
     for(;;)
     {
         if(fscanf(in, " %[^\r\n] ", tmp) != 1)
-        {
-            error= false;
             break;
-        }
         
         if(tmp[0] == '#')
             // saute les commentaires
             continue;
         
-        if(loadRegion(pathname + "/" + tmp) < 0)
-            break;
+        filenames.push_back(pathname + "/" + tmp);
     }
     
     fclose(in);
+    
+    // charge les regions en parallele, sans modifier le monde
+    const int n= (int) filenames.size();
+    std::vector<Region> regions(n);
+    std::vector<int> status(n, -1);
+    
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int i= 0; i < n; i++)
+        status[i]= regions[i].read(filenames[i]);
+    
+    // insere les regions dans le monde, dans l'ordre du fichier
+    bool error= false;
+    for(int i= 0; i < n; i++)
+    {
+        if(status[i] < 0 || insert(regions[i]) < 0)
+        {
+            printf("loading region '%s'... failed.\n", filenames[i].c_str());
+            error= true;
+        }
+    }
+    
     return error ? -1 : 0;
 }
     
 int World::loadRegion( const std::string& filename )
 {
-    printf("loading region '%s'...\n", filename.c_str());
+    Region region;
+    if(region.read(filename) < 0)
+        return -1;
+    
+    // insere la region et ses blocks dans le hachage spatial 
+    return insert(region);
+}
+
+// format des fichiers .gkmc
+// version 2 : "GKMC" en tete, ne peut pas etre confondu avec la taille (multiple de 4096) des donnees d'un fichier version 1.
+static const unsigned int GKMC_MAGIC= 0x434D4B47u;     // 'G' 'K' 'M' 'C'
+static const int GKMC_VERSION= 2;
+
+struct GKMCHeader
+{
+    unsigned int magic;
+    int version;
+    int count;          // nombre de blocks
+    int reserved;
+};
+
+struct GKMCBlock
+{
+    unsigned int offset;        // position des donnees dans le fichier, 0 si le block n'existe pas
+    unsigned int length;        // longueur des donnees compressees
+    unsigned int checksum;      // fnv-1a des donnees compressees
+};
+
+static
+unsigned int checksum( const unsigned char *data, const unsigned int length )
+{
+    unsigned int h= 2166136261u;
+    for(unsigned int i= 0; i < length; i++)
+    {
+        h^= data[i];
+        h*= 16777619u;
+    }
     
+    return h;
+}
+
+// compression rle : paires (longueur -1, valeur), longueur dans [1 256].
+// si la compression n'est pas efficace, les 4096 valeurs sont stockees directement.
+static
+void encode( const unsigned char *voxels, std::vector<unsigned char>& code )
+{
+    code.clear();
+    for(int i= 0; i < 4096; )
+    {
+        int n= 1;
+        while(i + n < 4096 && n < 256 && voxels[i + n] == voxels[i])
+            n++;
+        
+        code.push_back((unsigned char) (n -1));
+        code.push_back(voxels[i]);
+        i+= n;
+        
+        if(code.size() >= 4096)
+        {
+            code.assign(voxels, voxels + 4096);
+            return;
+        }
+    }
+}
+
+static
+int decode( const unsigned char *code, const unsigned int length, unsigned char *voxels )
+{
+    if(length == 4096)
+    {
+        // donnees non compressees
+        memcpy(voxels, code, 4096);
+        return 0;
+    }
+    
+    int n= 0;
+    for(unsigned int i= 0; i +1 < length; i+= 2)
+    {
+        int count= (int) code[i] +1;
+        if(n + count > 4096)
+            return -1;
+        
+        memset(voxels + n, code[i +1], count);
+        n+= count;
+    }
+    
+    return (n == 4096) ? 0 : -1;
+}
+
+// retrouve les coordonnees de la region dans le nom du fichier.
+static
+int region_bbox( const std::string& filename, Gridbox& rbox )
+{
     int x, z;
     if(sscanf(filename.c_str(), "%*[^.].%d.%d.gkmc", &x, &z) != 2)
-    {
-        printf("loading region '%s'... failed.\n", filename.c_str());
         return -1;
-    }
     
     // 1 region = 16*16*16 blocks
     // 1 block = 16*16*16 voxels
     // 1 region = 256*256*256 voxels
-    Gridbox rbox( Gridpoint(x*256, 0, z*256), Gridpoint(x*256 + 255, 255, z*256 + 255) );
-    
-    printf("  bbox %d, %d, %d  %d, %d, %d\n", rbox.pMin.x, rbox.pMin.y, rbox.pMin.z, rbox.pMax.x, rbox.pMax.y, rbox.pMax.z);
-    
-    FILE *in= fopen(filename.c_str(), "rb");
-    if(in == NULL)
+    rbox= Gridbox( Gridpoint(x*256, 0, z*256), Gridpoint(x*256 + 255, 255, z*256 + 255) );
+    return 0;
+}
+
+// renvoie la taille du fichier, sans modifier la position courante, ou -1 en cas d'erreur.
+static
+long int file_size( FILE *in )
+{
+    const long int position= ftell(in);
+    if(position < 0 || fseek(in, 0, SEEK_END) != 0)
         return -1;
     
-    int size= 0;        // nombre de blocks dans la region
-    if(fread(&size, sizeof(int), 1, in) != 1)
+    const long int size= ftell(in);
+    if(fseek(in, position, SEEK_SET) != 0)
         return -1;
-    
+    return size;
+}
+
+// version 1 : taille des donnees, index des blocks (ordre y, z, x), blocks non compresses.
+static
+int read_v1( FILE *in, const int size, Region& region )
+{
     // indexation des blocks
-    std::vector<short> blocks(4096, -1);
-    if(fread(&blocks.front(), sizeof(short), 4096, in) != 4096)
+    std::vector<short> index(4096, -1);
+    if(fread(&index.front(), sizeof(short), 4096, in) != 4096)
+        return -1;
+    
+    // verifie la taille avant d'allouer, comme read_v2()
+    const long int end= file_size(in);
+    const long int position= ftell(in);
+    if(end < 0 || position < 0 || size < 0 || size > end - position)
         return -1;
     
-    // donnees des blocks
+    // donnees des blocks, compressees lors de la creation des blocks
     std::vector<unsigned char> voxels(size, 0);
-    if(fread(&voxels.front(), sizeof(unsigned char), size, in) != (size_t) size)
+    if(size > 0 && fread(&voxels.front(), sizeof(unsigned char), size, in) != (size_t) size)
         return -1;
     
-    fclose(in);
+    int count= 0;
+    for(int i= 0; i < 4096; i++)
+        if(index[i] != -1)
+            count++;
+    region.data.reserve(count);
     
-    // cree les blocks et les insere dans le hachage spatial 
+    const Gridbox& rbox= region.bbox;
     int i= 0;
     for(int by= 0; by < 16; by++)
     for(int bz= 0; bz < 16; bz++)
     for(int bx= 0; bx < 16; bx++, i++)
-        if(blocks[i] != -1)
+        if(index[i] != -1)
         {
             // identifie la position des donnees du block
-            unsigned long int offset= (unsigned long int) blocks[i];
-            assert(offset * sizeof(char[16*16*16]) + 4096 <= (unsigned int) size);
+            unsigned long int offset= (unsigned long int) index[i];
+            if(offset * sizeof(char[16*16*16]) + 4096 > (unsigned int) size)
+                return -1;
             
             // boite englobante du block
             Gridpoint vmin(rbox.pMin.x + bx*16, rbox.pMin.y + by *16, rbox.pMin.z + bz*16);
             Gridpoint vmax(vmin.x + 15, vmin.y + 15, vmin.z + 15);
             
-            // insere le bloc dans le hachage spatial 
-            insert( Block(Gridbox(vmin, vmax), &voxels.front() + offset * sizeof(char[16*16*16])) );
+            // insere le bloc dans la region, les blocks du fichier ne sont pas ranges dans le meme ordre que Grid::index()
+            region.blocks[region.index(vmin)]= (int) region.data.push_back( Block(Gridbox(vmin, vmax), &voxels.front() + offset * sizeof(char[16*16*16])) );
         }
+    
+    return 0;
+}
+
+// verifie qu'une entree de la table des blocks designe des donnees presentes dans le fichier.
+static
+bool valid_entry( const GKMCBlock& entry, const unsigned int start, const unsigned long int size )
+{
+    return entry.offset >= start && entry.offset <= size && entry.length <= size - entry.offset;
+}
+
+// version 2 : en-tete, table des blocks (ordre Grid::index()), blocks compresses.
+static
+int read_v2( FILE *in, Region& region )
+{
+    const long int size= file_size(in);
+    if(size < 0)
+        return -1;
+    
+    GKMCHeader header;
+    if(fread(&header, sizeof(header), 1, in) != 1 || header.magic != GKMC_MAGIC || header.version != GKMC_VERSION)
+        return -1;
+    
+    std::vector<GKMCBlock> table(4096);
+    if(fread(&table.front(), sizeof(GKMCBlock), 4096, in) != 4096)
+        return -1;
+    
+    // charge toutes les donnees compressees en une seule lecture
+    const unsigned int start= sizeof(GKMCHeader) + 4096 * sizeof(GKMCBlock);
+    unsigned int end= start;
+    for(int i= 0; i < 4096; i++)
+        if(table[i].offset != 0)
+        {
+            // verifie les donnees avant d'allouer, un fichier tronque ou modifie ne doit pas provoquer d'allocation demesuree
+            if(valid_entry(table[i], start, size) == false)
+                return -1;
+            end= std::max(end, table[i].offset + table[i].length);
+        }
+    
+    std::vector<unsigned char> payload(end - start + 1);
+    if(end > start && fread(&payload.front(), 1, end - start, in) != end - start)
+        return -1;
+    
+    region.data.reserve(std::min(std::max(header.count, 0), 4096));
+    unsigned char voxels[4096];
+    for(int i= 0; i < 4096; i++)
+    {
+        if(table[i].offset == 0)
+            continue;
+        
+        const unsigned char *code= &payload.front() + (table[i].offset - start);
+        if(checksum(code, table[i].length) != table[i].checksum || decode(code, table[i].length, voxels) < 0)
+            return -1;
+        
+        // retrouve la position du block, ordre Grid::index() : y, x, z
+        Gridpoint vmin(region.bbox.pMin.x + ((i >> 4) & 15) * 16, region.bbox.pMin.y + (i >> 8) * 16, region.bbox.pMin.z + (i & 15) * 16);
+        Gridpoint vmax(vmin.x + 15, vmin.y + 15, vmin.z + 15);
+        assert(region.index(vmin) == i);
         
+        region.blocks[i]= (int) region.data.push_back( Block(Gridbox(vmin, vmax), voxels) );
+    }
+    
     return 0;
 }
+
+
+int Region::read( const std::string& filename )
+{
+    printf("loading region '%s'...\n", filename.c_str());
+    
+    Gridbox rbox;
+    if(region_bbox(filename, rbox) < 0)
+    {
+        printf("loading region '%s'... failed.\n", filename.c_str());
+        return -1;
+    }
+    
+    printf("  bbox %d, %d, %d  %d, %d, %d\n", rbox.pMin.x, rbox.pMin.y, rbox.pMin.z, rbox.pMax.x, rbox.pMax.y, rbox.pMax.z);
+    
+    FILE *in= fopen(filename.c_str(), "rb");
+    if(in == NULL)
+        return -1;
+    
+    // reinitialise la region
+    create(rbox);
+    blocks.assign(4096, -1);
+    data.clear();
+    
+    // identifie la version du fichier
+    int size= 0;
+    int code= -1;
+    if(fread(&size, sizeof(int), 1, in) == 1)
+    {
+        if((unsigned int) size == GKMC_MAGIC)
+        {
+            rewind(in);
+            code= read_v2(in, *this);
+        }
+        else
+            code= read_v1(in, size, *this);
+    }
+    
+    fclose(in);
+    if(code < 0)
+    {
+        printf("loading region '%s'... failed.\n", filename.c_str());
+        blocks.assign(4096, -1);
+        data.clear();
+        return -1;
+    }
+    
+    return 0;
+}
+
+int Region::read_block( const std::string& filename, const Gridpoint& p, Block& block )
+{
+    Gridbox rbox;
+    if(region_bbox(filename, rbox) < 0 || rbox.inside(p) == false)
+        return -1;
+    
+    FILE *in= fopen(filename.c_str(), "rb");
+    if(in == NULL)
+        return -1;
+    
+    // indices du block dans la region
+    const int bx= (p.x - rbox.pMin.x) / 16;
+    const int by= (p.y - rbox.pMin.y) / 16;
+    const int bz= (p.z - rbox.pMin.z) / 16;
+    Gridpoint vmin(rbox.pMin.x + bx*16, rbox.pMin.y + by*16, rbox.pMin.z + bz*16);
+    Gridpoint vmax(vmin.x + 15, vmin.y + 15, vmin.z + 15);
+    
+    unsigned char voxels[4096];
+    int code= -1;
+    int size= 0;
+    if(fread(&size, sizeof(int), 1, in) == 1)
+    {
+        if((unsigned int) size == GKMC_MAGIC)
+        {
+            // version 2 : lit l'entree de la table, puis les donnees du block
+            GKMCBlock entry;
+            std::vector<unsigned char> payload;
+            long int offset= sizeof(GKMCHeader) + (by * 256 + bx * 16 + bz) * sizeof(GKMCBlock);
+            const long int size= file_size(in);
+            if(size >= 0 && fseek(in, offset, SEEK_SET) == 0 && fread(&entry, sizeof(entry), 1, in) == 1 && entry.offset != 0
+            && valid_entry(entry, sizeof(GKMCHeader) + 4096 * sizeof(GKMCBlock), size))
+            {
+                payload.resize(entry.length + 1);
+                if(fseek(in, entry.offset, SEEK_SET) == 0 && fread(&payload.front(), 1, entry.length, in) == entry.length
+                && checksum(&payload.front(), entry.length) == entry.checksum)
+                    code= decode(&payload.front(), entry.length, voxels);
+            }
+        }
+        else
+        {
+            // version 1 : index des blocks ordonne y, z, x
+            short index= -1;
+            long int offset= sizeof(int) + (by * 256 + bz * 16 + bx) * sizeof(short);
+            if(fseek(in, offset, SEEK_SET) == 0 && fread(&index, sizeof(short), 1, in) == 1 && index != -1
+            && (unsigned long int) index * 4096 + 4096 <= (unsigned int) size
+            && fseek(in, sizeof(int) + 4096 * sizeof(short) + (long int) index * 4096, SEEK_SET) == 0
+            && fread(voxels, 1, 4096, in) == 4096)
+                code= 0;
+        }
+    }
+    
+    fclose(in);
+    if(code < 0)
+        return -1;
+    
+    block= Block(Gridbox(vmin, vmax), voxels);
+    return 0;
+}
+
+int Region::write( const std::string& filename ) const
+{
+    printf("writing region '%s'...\n", filename.c_str());
+    
+    FILE *out= fopen(filename.c_str(), "wb");
+    if(out == NULL)
+    {
+        printf("writing region '%s'... failed.\n", filename.c_str());
+        return -1;
+    }
+    
+    // compresse les blocks
+    GKMCHeader header;
+    header.magic= GKMC_MAGIC;
+    header.version= GKMC_VERSION;
+    header.count= 0;
+    header.reserved= 0;
+    
+    std::vector<GKMCBlock> table(4096);
+    std::vector<unsigned char> payload;
+    std::vector<unsigned char> code;
+    unsigned char voxels[4096];
+    
+    const unsigned int start= sizeof(GKMCHeader) + 4096 * sizeof(GKMCBlock);
+    for(int i= 0; i < 4096; i++)
+    {
+        table[i].offset= 0;
+        table[i].length= 0;
+        table[i].checksum= 0;
+        if(blocks[i] < 0)
+            continue;
+        
+        data[blocks[i]].decompress(voxels);
+        encode(voxels, code);
+        
+        table[i].offset= start + (unsigned int) payload.size();
+        table[i].length= (unsigned int) code.size();
+        table[i].checksum= checksum(&code.front(), code.size());
+        payload.insert(payload.end(), code.begin(), code.end());
+        header.count++;
+    }
+    
+    bool error= (fwrite(&header, sizeof(header), 1, out) != 1)
+        || (fwrite(&table.front(), sizeof(GKMCBlock), 4096, out) != 4096)
+        || (payload.size() > 0 && fwrite(&payload.front(), 1, payload.size(), out) != payload.size());
+    
+    if(fclose(out) != 0 || error)
+    {
+        printf("writing region '%s'... failed.\n", filename.c_str());
+        return -1;
+    }
+    
+    printf("  %d blocks, %u bytes\n", header.count, (unsigned int) (start + payload.size()));
+    return 0;
+}
+
+
+// enregistrement des donnees
+int World::saveRegion( const std::string& filename, const Gridpoint& p ) const
+{
+    const Region *r= region(p);
+    if(r == NULL)
+        return -1;
+    
+    return r->write(filename);
+}
+
+int World::saveMap( const std::string& pathname ) const
+{
+    std::string filename= pathname + ".txt";
+    printf("writing map '%s'...\n", filename.c_str());
+    
+    FILE *out= fopen(filename.c_str(), "wt");
+    if(out == NULL)
+    {
+        printf("writing map '%s'... failed\n", filename.c_str());
+        return -1;
+    }
+    
+    bool error= false;
+    for(unsigned int m= 0; m < data.size(); m++)
+    for(unsigned int r= 0; r < data[m].data.size(); r++)
+    {
+        const Region& region= data[m].data[r];
+        
+        // meme convention que loadRegion() : r.x.z.gkmc, x et z en regions
+        char tmp[1024];
+        sprintf(tmp, "r.%d.%d.gkmc", region.bbox.pMin.x / 256, region.bbox.pMin.z / 256);
+        if(region.write(pathname + "/" + tmp) < 0)
+        {
+            error= true;
+            continue;
+        }
+        
+        fprintf(out, "%s\n", tmp);
+    }
+    
+    fclose(out);
+    return error ? -1 : 0;
+}
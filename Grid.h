@@ -1,8 +1,12 @@
 #ifndef _GRID_H
 #define _GRID_H
 
+#include <new>
 #include <vector>
+#include <string>
 #include <climits>
+#include <cstring>
+#include <algorithm>
 
 #include "Vec.h"
 
@@ -153,6 +157,117 @@ struct Region;
 struct Block;
 
 
+/*! stockage des noeuds du monde (maps, regions, blocks) : les elements sont alloues par paquets de 64 et ne sont jamais deplaces
+ lorsque le stockage grandit. ajouter un element est en O(1) et ne copie pas les elements existants, contrairement a std::vector::push_back(),
+ les pointeurs sur les elements restent valides, jusqu'a la suppression de l'element, ou du dernier element, cf pop_back().
+ les elements sont identifies par leur indice, sur 32 bits.
+ */
+template < typename T >
+class GridPool
+{
+protected:
+    enum { CHUNK= 64 };
+    
+    std::vector<T *> m_chunks;
+    unsigned int m_size;
+    
+    T *slot( const unsigned int id ) const { return m_chunks[id / CHUNK] + id % CHUNK; }
+    
+public:
+    GridPool( ) : m_chunks(), m_size(0) {}
+    GridPool( const GridPool& b ) : m_chunks(), m_size(0)
+    {
+        reserve(b.m_size);
+        for(unsigned int i= 0; i < b.m_size; i++)
+            push_back(b[i]);
+    }
+    
+    GridPool& operator= ( const GridPool& b )
+    {
+        if(this != &b)
+        {
+            GridPool tmp(b);
+            swap(tmp);
+        }
+        return *this;
+    }
+    
+    ~GridPool( ) { clear(); }
+    
+    unsigned int size( ) const { return m_size; }
+    bool empty( ) const { return (m_size == 0); }
+    //! renvoie le nombre d'elements alloues.
+    size_t capacity( ) const { return m_chunks.size() * CHUNK; }
+    
+    T& operator[] ( const unsigned int id ) { assert(id < m_size); return *slot(id); }
+    const T& operator[] ( const unsigned int id ) const { assert(id < m_size); return *slot(id); }
+    T& back( ) { assert(m_size > 0); return *slot(m_size -1); }
+    const T& back( ) const { assert(m_size > 0); return *slot(m_size -1); }
+    
+    //! alloue la place pour n elements.
+    void reserve( const unsigned int n )
+    {
+        while(capacity() < n)
+            m_chunks.push_back( static_cast<T *>(::operator new(sizeof(T) * CHUNK)) );
+    }
+    
+    //! ajoute une copie de v, renvoie l'indice du nouvel element.
+    unsigned int push_back( const T& v )
+    {
+        reserve(m_size +1);
+        new(slot(m_size)) T(v);
+        return m_size++;
+    }
+    
+    //! detruit le dernier element.
+    void pop_back( )
+    {
+        assert(m_size > 0);
+        m_size--;
+        slot(m_size)->~T();
+    }
+    
+    //! detruit tous les elements et libere la memoire.
+    void clear( )
+    {
+        while(m_size > 0)
+            pop_back();
+        for(unsigned int i= 0; i < m_chunks.size(); i++)
+            ::operator delete(m_chunks[i]);
+        m_chunks.clear();
+    }
+    
+    //! echange le contenu de 2 stockages, sans copie.
+    void swap( GridPool& b )
+    {
+        m_chunks.swap(b.m_chunks);
+        std::swap(m_size, b.m_size);
+    }
+};
+
+
+//! cache du dernier block accede dans le monde. chaque thread utilise son propre cache.
+struct GridCache
+{
+    const Block *block;         //!< dernier block accede, ou NULL s'il n'existe pas.
+    int key;                    //!< identifiant du block, cf World::block_key(), -1 si le cache est vide.
+    unsigned int revision;      //!< version du monde lors du dernier acces, cf World::revision.
+    
+    GridCache( ) : block(NULL), key(-1), revision(0) {}
+};
+
+//! resultat d'un lancer de rayon dans le monde, cf World::intersect().
+struct GridHit
+{
+    Gridpoint voxel;            //!< voxel touche par le rayon.
+    Gridindex normal;           //!< normale de la face touchee, (0, 0, 0) si l'origine du rayon est dans le voxel.
+    float t;                    //!< abscisse du point d'intersection sur le rayon.
+    int value;                  //!< valeur du voxel touche.
+    
+    GridHit( ) : voxel(), normal(), t(0), value(0) {}
+};
+
+
 /*! representation du monde : hachage spatial d'un ensemble de maps.
  1 block= 16x16x16 voxels
  1 region = 16x16x16 blocks= 256x256x256 voxels
@@ -165,7 +280,7 @@ struct World : public Grid
         : 
         // fixe l'etendue du monde
         Grid( Gridsize(16, 1, 16), Gridbox(Gridpoint(-32768, 0, -32768), Gridpoint(32767, 255, 32767)) ),
-        maps(16*16, -1), data()
+        maps(16*16, -1), data(), dirty(), revision(0)
     {}
     
     const Map *map( const Gridpoint& p ) const;
@@ -175,12 +290,52 @@ struct World : public Grid
     const Block *block( const Gridpoint& p ) const;
     Block *block( const Gridpoint& p );
     
+    /*! acces direct aux voxels, sans passer par Map::region() et Region::block().
+    toutes les grilles du monde sont alignees et de dimension 16, les indices se calculent par decalage et masque, sans division.
+    renvoie la valeur du voxel, 0 si le block n'existe pas, ou -1 si p n'appartient pas au monde.
+    */
+    int voxel( const Gridpoint& p ) const;
+    //! renvoie la valeur du voxel, et conserve le block dans cache. utiliser un cache par thread.
+    int voxel( const Gridpoint& p, GridCache& cache ) const;
+    //! renvoie la valeur de n voxels, de preference voisins. renvoie le nombre de voxels appartenant au monde.
+    int voxels( const Gridpoint *points, const int n, int *values, GridCache& cache ) const;
+    
+    /*! renvoie le premier voxel non vide le long du rayon origin + t * direction, t dans [0 tmax].
+    parcours hierarchique (Amanatides & Woo) : les maps, regions et blocks absents ou vides sont traverses en 1 pas, 
+    les voxels ne sont parcourus que dans les blocks non vides.
+    */
+    bool intersect( const gk::Vec3& origin, const gk::Vec3& direction, const float tmax, GridHit& hit ) const;
+    
+    //! modifie la valeur du voxel p, cree le block si necessaire. renvoie -1 si p n'appartient pas au monde.
+    //! le block et les blocks voisins, si le voxel est sur une face du block, sont marques comme modifies, cf dirty.
+    int set( const Gridpoint& p, const unsigned char v );
+    
+    //! renvoie le block identifie par key, ou NULL s'il n'existe pas, cf block_key().
+    const Block *find_block( const int key ) const;
+    Block *find_block( const int key ) { return const_cast<Block *>(static_cast<const World *>(this)->find_block(key)); }
+    //! renvoie l'identifiant du block contenant p, ou -1 si p n'appartient pas au monde.
+    static int block_key( const Gridpoint& p );
+    
     int loadMap( const std::string& filename );
     int loadRegion( const std::string& filename );
+    //! enregistre toutes les regions du monde dans le repertoire pathname, qui doit exister, et la liste des regions dans pathname.txt, cf loadMap().
+    int saveMap( const std::string& pathname ) const;
+    //! enregistre la region contenant p, cf Region::write().
+    int saveRegion( const std::string& filename, const Gridpoint& p ) const;
+    
     int insert( const Block& block );
+    //! insere une region complete dans le monde. le contenu de region est transfere dans le monde, sans copie, region est vide au retour.
+    int insert( Region& region );
+    //! retire la region contenant p du monde et libere ses donnees.
+    int remove( const Gridpoint& p );
     
-    std::vector<short> maps;    //!< index spatial
-    std::vector<Map> data;      //!< donnees
+    //! renvoie la map contenant p, la cree si necessaire. renvoie NULL si p n'appartient pas au monde.
+    Map *create_map( const Gridpoint& p );
+    
+    std::vector<int> maps;      //!< index spatial, indice de la map dans data, ou -1
+    GridPool<Map> data;         //!< donnees
+    std::vector<int> dirty;     //!< identifiants des blocks modifies, cf set() et block_key().
+    unsigned int revision;      //!< incremente a chaque modification du hachage spatial, invalide les GridCache.
 };
 
 //! representation d'une map : hachage spatial 16x1x16 d'un ensemble de regions.
@@ -194,8 +349,8 @@ struct Map : public Grid
     const Block *block( const Gridpoint& p ) const;
     Block *block( const Gridpoint& p );
     
-    std::vector<short> regions; //!< index spatial
-    std::vector<Region> data;   //!< donnees
+    std::vector<int> regions;   //!< index spatial, indice de la region dans data, ou -1
+    GridPool<Region> data;      //!< donnees
 };
 
 //! representation d'une region : hachage spatial 16x16x16 d'un ensemble de blocks.
@@ -207,24 +362,207 @@ struct Region : public Grid
     const Block *block( const Gridpoint& p ) const;     // renvoie l'ensemble de voxels autour des coordonnees de p, ou NULL en cas d'erreur.
     Block *block( const Gridpoint& p );     // renvoie l'ensemble de voxels autour des coordonnees de p, ou NULL en cas d'erreur.
     
-    std::vector<short> blocks;  //!< index spatial
-    std::vector<Block> data;    //!< donnees
+    //! charge une region, sans l'inserer dans le monde, cf World::insert( Region& ). peut etre utilise par plusieurs threads.
+    int read( const std::string& filename );
+    //! charge un seul block d'une region, sans charger la region complete. renvoie -1 si le block n'existe pas.
+    static int read_block( const std::string& filename, const Gridpoint& p, Block& block );
+    
+    /*! enregistre une region au format .gkmc version 2 : 
+        en-tete : "GKMC", version, nombre de blocks, 
+        table de 4096 blocks, ordre Grid::index() : position, longueur et somme de controle des donnees compressees,
+        donnees des blocks compressees (rle), ou non compressees si la compression n'est pas efficace.
+    les fichiers version 1 (taille, index de 4096 short, blocks non compresses) restent lisibles par read().
+    */
+    int write( const std::string& filename ) const;
+    
+    /*! renvoie les voxels du block contenant p au niveau de detail level, dans [1 4] : (16 >> level)^3 valeurs, ordre Grid::index(). 
+    construit la pyramide du block si necessaire, cf Block::build_mips(). renvoie NULL si le block n'existe pas.
+    */
+    const unsigned char *lod_block( const Gridpoint& p, const int level );
+    //! renvoie la valeur de la cellule contenant p au niveau de detail level, dans [0 4], 0 si le block n'existe pas, ou -1 si p n'appartient pas a la region.
+    int lod_voxel( const Gridpoint& p, const int level );
+    //! construit les pyramides de tous les blocks, en parallele. Block::mip() peut ensuite etre utilise par plusieurs threads.
+    void build_lods( );
+    
+    //! echange le contenu de 2 regions, sans copie.
+    void swap( Region& b );
+    //! renvoie la taille occupee en memoire par la region, en octets.
+    size_t memory( ) const;
+    
+    std::vector<int> blocks;    //!< index spatial, indice du block dans data, ou -1
+    GridPool<Block> data;       //!< donnees
 };
 
 //! representation d'un block : enumeration spatiale de 16x16x16 voxels.
+/*! les voxels sont compresses : chaque voxel est un indice dans la palette des valeurs presentes dans le block,
+ code sur 1, 2, 4 ou 8 bits. un block uniforme (que de l'air, par exemple) ne stocke que sa palette.
+ */
 struct Block : public Grid
 {
-    Block( ) : Grid(Gridsize(16, 16, 16)) {}
-    Block( const Gridbox& _bbox ) : Grid(Gridsize(16, 16, 16), _bbox) {}
+    //! occupation des voxels du block.
+    enum
+    {
+        EMPTY= 0,       //!< que de l'air.
+        MIXED,          //!< voxels vides et non vides, cf occupancy.
+        SOLID           //!< aucun voxel vide.
+    };
     
-    Block( const Gridbox& _bbox, const std::vector<unsigned char>& voxels ) : Grid(Gridsize(16, 16, 16), _bbox), data(voxels) { assert(voxels.size() == 4096); }
-    Block( const Gridbox& _bbox, unsigned char *voxels ) : Grid(Gridsize(16, 16, 16), _bbox), data(voxels, voxels + 4096) { assert(data.size() == 4096); }
+    Block( ) : Grid(Gridsize(16, 16, 16)), palette(1, 0), bits(), bits_per_voxel(0), occupancy(), fill(EMPTY), mips(), dirty(false) {}
+    Block( const Gridbox& _bbox ) : Grid(Gridsize(16, 16, 16), _bbox), palette(1, 0), bits(), bits_per_voxel(0), occupancy(), fill(EMPTY), mips(), dirty(false) {}
+    
+    Block( const Gridbox& _bbox, const std::vector<unsigned char>& voxels ) : Grid(Gridsize(16, 16, 16), _bbox), palette(), bits(), bits_per_voxel(0), occupancy(), fill(EMPTY), mips(), dirty(false) { assert(voxels.size() == 4096); compress(&voxels.front()); }
+    Block( const Gridbox& _bbox, const unsigned char *voxels ) : Grid(Gridsize(16, 16, 16), _bbox), palette(), bits(), bits_per_voxel(0), occupancy(), fill(EMPTY), mips(), dirty(false) { compress(voxels); }
     
     int voxel( const Gridpoint& p ) const;
     int voxel( const Gridindex& index )  const;
     
-    std::vector<unsigned char> data;    //!< 16x16x16 == 4096 valeurs
+    //! renvoie la valeur du voxel d'indice lineaire id, cf Grid::index().
+    int value( const int id ) const
+    {
+        assert(id >= 0 && id < 4096);
+        if(bits_per_voxel == 0)
+            return palette[0];
+        
+        const unsigned int offset= (unsigned int) id * bits_per_voxel;
+        const unsigned int mask= (1u << bits_per_voxel) -1u;
+        return palette[(bits[offset >> 5] >> (offset & 31u)) & mask];
+    }
+    
+    //! renvoie vrai si le voxel d'indice lineaire id n'est pas vide, sans decoder sa valeur.
+    bool occupied( const int id ) const
+    {
+        assert(id >= 0 && id < 4096);
+        if(fill != MIXED)
+            return (fill == SOLID);
+        return ((occupancy[id >> 6] >> (id & 63)) & 1u) != 0;
+    }
+    
+    //! renvoie vrai si le block ne contient que de l'air.
+    bool empty( ) const { return (fill == EMPTY); }
+    //! renvoie vrai si le block ne contient aucun voxel vide.
+    bool solid( ) const { return (fill == SOLID); }
+    //! renvoie vrai si tous les voxels d'une face du block ne sont pas vides. face : 0 -x, 1 +x, 2 -y, 3 +y, 4 -z, 5 +z.
+    bool face_full( const int face ) const;
+    
+    //! modifie la valeur du voxel d'indice lineaire id, cf Grid::index().
+    void set( const int id, const unsigned char v );
+    
+    //! compresse les 4096 valeurs de voxels.
+    void compress( const unsigned char *voxels );
+    //! calcule l'occupation des voxels : occupancy et fill.
+    void summarize( const unsigned char *voxels );
+    //! calcule l'occupation des voxels a partir des 64 mots de 64 bits, cf occupancy.
+    void summarize( const unsigned long long *words );
+    //! decompresse les valeurs des voxels, voxels doit pouvoir stocker 4096 valeurs.
+    void decompress( unsigned char *voxels ) const;
+    //! renvoie vrai si tous les voxels ont la meme valeur.
+    bool uniform( ) const { return (bits_per_voxel == 0); }
+    
+    /*! construit la pyramide de niveaux de detail du block : 8x8x8, 4x4x4, 2x2x2 et 1 cellule.
+    une cellule est vide si ses 8 cellules filles sont vides, sinon elle prend la valeur non vide la plus frequente :
+    les parois minces sont conservees, les rayons et les meshs simplifies ne traversent pas la matiere.
+    */
+    void build_mips( );
+    //! renvoie les (16 >> level)^3 valeurs du niveau de detail level, dans [1 4], ordre Grid::index(), ou NULL si la pyramide n'est pas construite.
+    const unsigned char *mip( const int level ) const
+    {
+        assert(level >= 1 && level <= 4);
+        if(mips.empty())
+            return NULL;
+        
+        static const int offsets[5]= { 0, 0, 512, 512+64, 512+64+8 };
+        return &mips[offsets[level]];
+    }
+    
+    //! renvoie la taille occupee en memoire par le block, en octets.
+    size_t memory( ) const { return sizeof(Block) + palette.capacity() + bits.capacity() * sizeof(unsigned int) + occupancy.capacity() * sizeof(unsigned long long) + mips.capacity(); }
+    
+    std::vector<unsigned char> palette; //!< valeurs des voxels presentes dans le block.
+    std::vector<unsigned int> bits;     //!< indices des 16x16x16 voxels dans la palette, vide si le block est uniforme.
+    int bits_per_voxel;                 //!< 0 (block uniforme), 1, 2, 4 ou 8 bits.
+    
+    std::vector<unsigned long long> occupancy;  //!< 1 bit par voxel non vide, ordre Grid::index(), 64 mots. vide si le block n'est pas MIXED.
+    int fill;                           //!< EMPTY, MIXED ou SOLID.
+    
+    std::vector<unsigned char> mips;    //!< niveaux de detail, 512+64+8+1 valeurs, vide si la pyramide n'est pas construite ou si le block a ete modifie, cf build_mips().
+    
+    bool dirty;                         //!< vrai si le block, ou un voxel voisin, a ete modifie, cf World::set().
 };
 
 
+// acces direct, cf World::voxel().
+// coordonnees du monde decalees dans [0 65536) x [0 256) x [0 65536) :
+//  bits 12..15 : map, bits 8..11 : region, bits 4..7 : block, bits 0..3 : voxel.
+inline
+int World::block_key( const Gridpoint& p )
+{
+    const unsigned int ux= (unsigned int) (p.x + 32768);
+    const unsigned int uy= (unsigned int) p.y;
+    const unsigned int uz= (unsigned int) (p.z + 32768);
+    if(ux > 65535u || uy > 255u || uz > 65535u)
+        return -1;
+    
+    // 12 bits x, 4 bits y, 12 bits z
+    return (int) (((ux >> 4) << 16) | ((uy >> 4) << 12) | (uz >> 4));
+}
+
+inline
+const Block *World::find_block( const int key ) const
+{
+    assert(key >= 0);
+    const unsigned int bx= (unsigned int) key >> 16;
+    const unsigned int by= ((unsigned int) key >> 12) & 15u;
+    const unsigned int bz= (unsigned int) key & 4095u;
+    
+    // meme ordre que Grid::index() : y * size.x*size.z + x * size.z + z
+    const int m= maps[(bx >> 8) * 16u + (bz >> 8)];
+    if(m < 0)
+        return NULL;
+    const Map& map= data[m];
+    
+    const int r= map.regions[((bx >> 4) & 15u) * 16u + ((bz >> 4) & 15u)];
+    if(r < 0)
+        return NULL;
+    const Region& region= map.data[r];
+    
+    const int b= region.blocks[by * 256u + (bx & 15u) * 16u + (bz & 15u)];
+    if(b < 0)
+        return NULL;
+    return &region.data[b];
+}
+
+inline
+int World::voxel( const Gridpoint& p ) const
+{
+    const int key= block_key(p);
+    if(key < 0)
+        return -1;
+    
+    const Block *b= find_block(key);
+    if(b == NULL)
+        return 0;
+    
+    return b->value((p.y & 15) * 256 + (p.x & 15) * 16 + (p.z & 15));
+}
+
+inline
+int World::voxel( const Gridpoint& p, GridCache& cache ) const
+{
+    const int key= block_key(p);
+    if(key < 0)
+        return -1;
+    
+    if(key != cache.key || cache.revision != revision)
+    {
+        cache.block= find_block(key);
+        cache.key= key;
+        cache.revision= revision;
+    }
+    
+    if(cache.block == NULL)
+        return 0;
+    return cache.block->value((p.y & 15) * 256 + (p.x & 15) * 16 + (p.z & 15));
+}
+
+
 #endif
@@ -0,0 +1,373 @@
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "GridMesh.h"
+
+
+// cf block_names.cpp
+extern const char *block_names[];
+
+
+// recupere les voxels du block et la couche de voxels voisins de chaque face.
+void BlockVoxels::read( const World& world, const Block& block )
+{
+    pmin= block.bbox.pMin;
+    memset(data, 0, sizeof(data));
+
+    // voxels du block, meme ordre que Grid::index() : y, x, z
+    unsigned char voxels[4096];
+    block.decompress(voxels);
+    for(int y= 0; y < 16; y++)
+    for(int x= 0; x < 16; x++)
+        memcpy(&data[((y +1) * 18 + (x +1)) * 18 + 1], &voxels[y * 256 + x * 16], 16);
+
+    // voxels des blocks voisins, 0 si le voisin n'existe pas ou n'appartient pas au monde.
+    // chaque voisin est recupere une seule fois, seule la couche de voxels en contact avec le block est decodee.
+    const Gridpoint neighbours[6]=
+    {
+        Gridpoint(pmin.x -16, pmin.y, pmin.z), Gridpoint(pmin.x +16, pmin.y, pmin.z),
+        Gridpoint(pmin.x, pmin.y -16, pmin.z), Gridpoint(pmin.x, pmin.y +16, pmin.z),
+        Gridpoint(pmin.x, pmin.y, pmin.z -16), Gridpoint(pmin.x, pmin.y, pmin.z +16)
+    };
+
+    for(int f= 0; f < 6; f++)
+    {
+        const int key= World::block_key(neighbours[f]);
+        const Block *neighbour= (key < 0) ? NULL : world.find_block(key);
+        if(neighbour == NULL || neighbour->empty())
+            continue;
+
+        const int layer= (f & 1) ? 0 : 15;         // couche du voisin en contact avec le block
+        const int border= (f & 1) ? 16 : -1;       // position de cette couche autour du block
+        for(int a= 0; a < 16; a++)
+        for(int b= 0; b < 16; b++)
+        {
+            int x, y, z;            // voxel du voisin
+            int bx, by, bz;         // voxel autour du block
+            if(f < 2)       { x= layer; y= a; z= b; bx= border; by= a; bz= b; }
+            else if(f < 4)  { x= a; y= layer; z= b; bx= a; by= border; bz= b; }
+            else            { x= a; y= b; z= layer; bx= a; by= b; bz= border; }
+
+            data[((by +1) * 18 + (bx +1)) * 18 + (bz +1)]= (unsigned char) neighbour->value(y * 256 + x * 16 + z);
+        }
+    }
+
+    // occupation : lignes du block copiees depuis Block::occupancy, 16 bits par ligne, les voisins depuis les valeurs
+    for(int y= -1; y <= 16; y++)
+    for(int x= -1; x <= 16; x++)
+    {
+        const unsigned char *line= &data[((y +1) * 18 + (x +1)) * 18];
+        unsigned int bits= 0;
+        if(x >= 0 && x < 16 && y >= 0 && y < 16)
+        {
+            if(block.solid())
+                bits= 0xFFFFu;
+            else if(block.empty() == false)
+                bits= (unsigned int) (block.occupancy[(y * 256 + x * 16) >> 6] >> ((x & 3) * 16)) & 0xFFFFu;
+            bits= (bits << 1) | (line[0] ? 1u : 0u) | (line[17] ? (1u << 17) : 0u);
+        }
+        else
+        {
+            for(int z= 0; z < 18; z++)
+                if(line[z])
+                    bits|= 1u << z;
+        }
+
+        rows[(y +1) * 18 + (x +1)]= bits;
+    }
+}
+
+
+namespace {
+
+//! rectangle de faces de voxels.
+struct Quad
+{
+    int material;
+    int axis;           //!< normale : 0= x, 1= y, 2= z
+    int side;           //!< -1 ou +1
+    int plane;          //!< position du plan sur l'axe de la normale
+    int u, v;           //!< coin du rectangle dans le plan
+    int du, dv;         //!< dimensions du rectangle dans le plan
+
+    bool operator< ( const Quad& b ) const { return (material < b.material); }
+};
+
+// nombre de noms de matieres dans block_names[], termine par NULL.
+int block_names_count( )
+{
+    static int count= -1;
+    if(count < 0)
+    {
+        int n= 0;
+        while(block_names[n] != NULL)
+            n++;
+        count= n;
+    }
+
+    return count;
+}
+
+gk::MeshMaterial block_material( const int value )
+{
+    static const int count= block_names_count();
+    if(value < count && block_names[value][0] != 0)
+        return gk::MeshMaterial(block_names[value]);
+
+    char tmp[64];
+    sprintf(tmp, "block_%d", value);
+    return gk::MeshMaterial(tmp);
+}
+
+}       // namespace
+
+
+gk::Mesh *buildBlockMesh( const BlockVoxels& voxels )
+{
+    std::vector<Quad> quads;
+
+    // pour chaque axe, chaque direction et chaque tranche du block, construit le masque des faces visibles,
+    // puis les fusionne en rectangles maximaux.
+    int mask[16*16];
+    unsigned int visible[16*16];
+    for(int axis= 0; axis < 3; axis++)
+    {
+        // repere du plan : (axis, u, v) est direct
+        const int ua= (axis +1) % 3;
+        const int va= (axis +2) % 3;
+
+        for(int side= -1; side <= 1; side+= 2)
+        {
+            // faces visibles, 1 mot par ligne (x, y) : voxel occupe et voisin vide dans la direction side
+            unsigned int any= 0;
+            for(int x= 0; x < 16; x++)
+            for(int y= 0; y < 16; y++)
+            {
+                const unsigned int a= voxels.row(x, y);
+                unsigned int b;
+                if(axis == 0)
+                    b= voxels.row(x + side, y);
+                else if(axis == 1)
+                    b= voxels.row(x, y + side);
+                else
+                    b= (side > 0) ? (a >> 1) : (a << 1);
+
+                visible[x * 16 + y]= ((a & ~b) >> 1) & 0xFFFFu;
+                any|= visible[x * 16 + y];
+            }
+
+            if(any == 0)
+                continue;
+
+            for(int slice= 0; slice < 16; slice++)
+            {
+                // tranche sans face visible
+                unsigned int faces= 0;
+                if(axis == 0)
+                    for(int y= 0; y < 16; y++)
+                        faces|= visible[slice * 16 + y];
+                else if(axis == 1)
+                    for(int x= 0; x < 16; x++)
+                        faces|= visible[x * 16 + slice];
+                else
+                    faces= any & (1u << slice);
+
+                if(faces == 0)
+                    continue;
+
+                // ne decode que les voxels des faces visibles
+                for(int u= 0; u < 16; u++)
+                for(int v= 0; v < 16; v++)
+                {
+                    int p[3];
+                    p[axis]= slice;
+                    p[ua]= u;
+                    p[va]= v;
+
+                    mask[u * 16 + v]= ((visible[p[0] * 16 + p[1]] >> p[2]) & 1u) ? voxels.value(p[0], p[1], p[2]) : 0;
+                }
+
+                // fusionne les faces de meme matiere
+                for(int u= 0; u < 16; u++)
+                for(int v= 0; v < 16; )
+                {
+                    const int m= mask[u * 16 + v];
+                    if(m == 0)
+                    {
+                        v++;
+                        continue;
+                    }
+
+                    // etend le rectangle le long de v, puis le long de u
+                    int dv= 1;
+                    while(v + dv < 16 && mask[u * 16 + v + dv] == m)
+                        dv++;
+
+                    int du= 1;
+                    for(; u + du < 16; du++)
+                    {
+                        bool complete= true;
+                        for(int k= 0; k < dv; k++)
+                            if(mask[(u + du) * 16 + v + k] != m)
+                            {
+                                complete= false;
+                                break;
+                            }
+
+                        if(complete == false)
+                            break;
+                    }
+
+                    Quad q;
+                    q.material= m;
+                    q.axis= axis;
+                    q.side= side;
+                    q.plane= (side > 0) ? slice +1 : slice;
+                    q.u= u;
+                    q.v= v;
+                    q.du= du;
+                    q.dv= dv;
+                    quads.push_back(q);
+
+                    // retire les faces du rectangle
+                    for(int l= 0; l < du; l++)
+                    for(int k= 0; k < dv; k++)
+                        mask[(u + l) * 16 + v + k]= 0;
+
+                    v+= dv;
+                }
+            }
+        }
+    }
+
+    if(quads.empty())
+        return NULL;
+
+    // regroupe les faces par matiere
+    std::stable_sort(quads.begin(), quads.end());
+
+    gk::Mesh *mesh= new gk::Mesh;
+    mesh->positions.reserve(quads.size() * 4);
+    mesh->normals.reserve(quads.size() * 4);
+    mesh->texcoords.reserve(quads.size() * 4);
+    mesh->indices.reserve(quads.size() * 6);
+    mesh->materials.reserve(quads.size() * 2);
+
+    for(unsigned int i= 0; i < quads.size(); i++)
+    {
+        const Quad& q= quads[i];
+        if(i == 0 || quads[i -1].material != q.material)
+            mesh->groups.push_back( gk::MeshGroup(block_material(q.material), mesh->indices.size()) );
+
+        const int ua= (q.axis +1) % 3;
+        const int va= (q.axis +2) % 3;
+
+        // 4 sommets, dans l'ordre trigo vu depuis l'exterieur
+        const int corners[4][2]= { { 0, 0 }, { q.du, 0 }, { q.du, q.dv }, { 0, q.dv } };
+        const unsigned int base= mesh->positions.size();
+        for(int c= 0; c < 4; c++)
+        {
+            const int k= (q.side > 0) ? c : (4 - c) % 4;
+
+            float p[3];
+            p[q.axis]= q.plane;
+            p[ua]= q.u + corners[k][0];
+            p[va]= q.v + corners[k][1];
+
+            float n[3]= { 0, 0, 0 };
+            n[q.axis]= q.side;
+
+            mesh->positions.push_back( gk::Vec3(voxels.pmin.x + p[0], voxels.pmin.y + p[1], voxels.pmin.z + p[2]) );
+            mesh->normals.push_back( gk::Vec3(n[0], n[1], n[2]) );
+            mesh->texcoords.push_back( gk::Vec3(corners[k][0], corners[k][1], 0) );
+        }
+
+        mesh->indices.push_back(base);
+        mesh->indices.push_back(base +1);
+        mesh->indices.push_back(base +2);
+        mesh->indices.push_back(base);
+        mesh->indices.push_back(base +2);
+        mesh->indices.push_back(base +3);
+
+        mesh->materials.push_back(mesh->groups.size() -1);
+        mesh->materials.push_back(mesh->groups.size() -1);
+        mesh->groups.back().end= mesh->indices.size();
+    }
+
+    return mesh;
+}
+
+// renvoie vrai si le block est plein et si les faces de ses 6 voisins qui le touchent sont pleines, aucune face n'est visible.
+static
+bool hidden( const World& world, const Block& block )
+{
+    if(block.solid() == false)
+        return false;
+    
+    const Gridpoint& p= block.bbox.pMin;
+    const Gridpoint neighbours[6]= 
+    {
+        Gridpoint(p.x -16, p.y, p.z), Gridpoint(p.x +16, p.y, p.z),
+        Gridpoint(p.x, p.y -16, p.z), Gridpoint(p.x, p.y +16, p.z),
+        Gridpoint(p.x, p.y, p.z -16), Gridpoint(p.x, p.y, p.z +16)
+    };
+    
+    for(int i= 0; i < 6; i++)
+    {
+        const int key= World::block_key(neighbours[i]);
+        const Block *b= (key < 0) ? NULL : world.find_block(key);
+        if(b == NULL || b->face_full(i ^ 1) == false)
+            return false;
+    }
+    
+    return true;
+}
+
+gk::Mesh *buildBlockMesh( const World& world, const Block& block )
+{
+    if(block.empty() || hidden(world, block))
+        return NULL;    // que de l'air, ou entoure de blocks pleins
+
+    BlockVoxels voxels;
+    voxels.read(world, block);
+    return buildBlockMesh(voxels);
+}
+
+int buildWorldMeshes( const World& world, std::vector<const Block *>& blocks, std::vector<gk::Mesh *>& meshes )
+{
+    blocks.clear();
+    for(unsigned int m= 0; m < world.data.size(); m++)
+    for(unsigned int r= 0; r < world.data[m].data.size(); r++)
+    for(unsigned int b= 0; b < world.data[m].data[r].data.size(); b++)
+        blocks.push_back(&world.data[m].data[r].data[b]);
+
+    const int n= (int) blocks.size();
+    meshes.assign(n, NULL);
+
+    #pragma omp parallel
+    {
+        // 1 copie des voxels par thread
+        BlockVoxels *voxels= new BlockVoxels;
+
+        #pragma omp for schedule(dynamic, 16)
+        for(int i= 0; i < n; i++)
+        {
+            if(blocks[i]->empty() || hidden(world, *blocks[i]))
+                continue;   // que de l'air, ou entoure de blocks pleins
+
+            voxels->read(world, *blocks[i]);
+            meshes[i]= buildBlockMesh(*voxels);
+        }
+
+        delete voxels;
+    }
+
+    int count= 0;
+    for(int i= 0; i < n; i++)
+        if(meshes[i] != NULL)
+            count++;
+
+    return count;
+}
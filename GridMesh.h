@@ -0,0 +1,52 @@
+
+#ifndef _GRID_MESH_H
+#define _GRID_MESH_H
+
+#include <vector>
+
+#include "Grid.h"
+#include "Mesh.h"
+
+
+//! voxels d'un block et voxels des blocks voisins, par une face : grille 18x18x18, le block occupe [0 15]^3, les voisins -1 et 16.
+struct BlockVoxels
+{
+    Gridpoint pmin;                     //!< coin du block dans le monde.
+    unsigned char data[18*18*18];       //!< valeurs des voxels, 0 pour l'air et en dehors du monde.
+    unsigned int rows[18*18];           //!< occupation des voxels : bit z+1 de rows[(y+1)*18 + x+1] si le voxel (x, y, z) n'est pas vide.
+
+    //! renvoie la valeur d'un voxel, coordonnees locales au block, dans [-1 16].
+    int value( const int x, const int y, const int z ) const
+    {
+        assert(x >= -1 && x <= 16 && y >= -1 && y <= 16 && z >= -1 && z <= 16);
+        return data[((y +1) * 18 + (x +1)) * 18 + (z +1)];
+    }
+
+    //! renvoie l'occupation de la ligne de voxels (x, y, -1..16), coordonnees locales au block, dans [-1 16].
+    unsigned int row( const int x, const int y ) const
+    {
+        assert(x >= -1 && x <= 16 && y >= -1 && y <= 16);
+        return rows[(y +1) * 18 + (x +1)];
+    }
+
+    //! recupere les voxels du block et la couche de voxels en contact des 6 blocks voisins dans le monde.
+    void read( const World& world, const Block& block );
+};
+
+
+//! construit les faces visibles des voxels du block, fusionnees en rectangles maximaux (greedy meshing).
+/*! une face est visible si le voxel voisin est de l'air (valeur 0).
+ les faces sont regroupees par matiere, cf block_names[], 1 MeshGroup par matiere.
+ les positions sont exprimees dans le repere du monde, les coordonnees de texture en voxels, pour repeter les textures.
+ renvoie NULL si le block ne contient aucune face visible.
+ */
+gk::Mesh *buildBlockMesh( const BlockVoxels& voxels );
+
+//! construit les faces visibles d'un block du monde, en tenant compte des blocks voisins.
+gk::Mesh *buildBlockMesh( const World& world, const Block& block );
+
+//! construit les faces visibles de tous les blocks du monde, en parallele.
+//! blocks[i] et meshes[i] sont associes, meshes[i] est NULL si le block ne contient aucune face visible.
+int buildWorldMeshes( const World& world, std::vector<const Block *>& blocks, std::vector<gk::Mesh *>& meshes );
+
+#endif
@@ -0,0 +1,262 @@
+
+#include <cstdio>
+
+#include "GridMeshCache.h"
+
+
+GridMeshCache::GridMeshCache( World& world )
+    :
+    m_world(world), m_meshes(), m_generations(), m_generation(0), m_revision(world.revision),
+    m_jobs(), m_results(), m_busy(0), m_stop(false),
+    m_thread(NULL), m_lock(NULL), m_wakeup(NULL), m_done(NULL)
+{
+    m_lock= SDL_CreateMutex();
+    m_wakeup= SDL_CreateCond();
+    m_done= SDL_CreateCond();
+    m_thread= SDL_CreateThread(builder, "block mesher", this);
+    if(m_thread == NULL)
+        printf("mesh cache: error creating mesher thread.\n");
+}
+
+GridMeshCache::~GridMeshCache( )
+{
+    SDL_LockMutex(m_lock);
+    m_stop= true;
+    SDL_CondSignal(m_wakeup);
+    SDL_UnlockMutex(m_lock);
+
+    SDL_WaitThread(m_thread, NULL);
+
+    for(unsigned int i= 0; i < m_jobs.size(); i++)
+        delete m_jobs[i].voxels;
+    for(unsigned int i= 0; i < m_results.size(); i++)
+        delete m_results[i].mesh;
+    for(std::map<int, gk::Mesh *>::iterator it= m_meshes.begin(); it != m_meshes.end(); ++it)
+        delete it->second;
+
+    SDL_DestroyCond(m_done);
+    SDL_DestroyCond(m_wakeup);
+    SDL_DestroyMutex(m_lock);
+}
+
+
+int GridMeshCache::builder( void *data )
+{
+    GridMeshCache *cache= (GridMeshCache *) data;
+
+    SDL_LockMutex(cache->m_lock);
+    for(;;)
+    {
+        while(cache->m_stop == false && cache->m_jobs.empty())
+            SDL_CondWait(cache->m_wakeup, cache->m_lock);
+        if(cache->m_stop)
+            break;
+
+        Job job= cache->m_jobs.front();
+        cache->m_jobs.pop_front();
+        cache->m_busy++;
+        SDL_UnlockMutex(cache->m_lock);
+
+        // construit le mesh a partir de la copie des voxels, sans acceder au monde
+        gk::Mesh *mesh= buildBlockMesh(*job.voxels);
+        delete job.voxels;
+
+        SDL_LockMutex(cache->m_lock);
+        cache->m_results.push_back( Result(job.key, job.generation, mesh) );
+        cache->m_busy--;
+        SDL_CondSignal(cache->m_done);
+    }
+    SDL_UnlockMutex(cache->m_lock);
+
+    return 0;
+}
+
+
+int GridMeshCache::build( )
+{
+    // abandonne les reconstructions en cours, leurs resultats seront ignores par commit()
+    SDL_LockMutex(m_lock);
+    for(unsigned int i= 0; i < m_jobs.size(); i++)
+        delete m_jobs[i].voxels;
+    m_jobs.clear();
+    SDL_UnlockMutex(m_lock);
+    m_generations.clear();
+
+    // remplace tous les meshs, y compris ceux des regions retirees du monde
+    for(std::map<int, gk::Mesh *>::iterator it= m_meshes.begin(); it != m_meshes.end(); ++it)
+        delete it->second;
+    m_meshes.clear();
+
+    std::vector<const Block *> blocks;
+    std::vector<gk::Mesh *> meshes;
+    buildWorldMeshes(m_world, blocks, meshes);
+
+    for(unsigned int i= 0; i < blocks.size(); i++)
+        if(meshes[i] != NULL)
+            m_meshes[World::block_key(blocks[i]->bbox.pMin)]= meshes[i];
+    m_revision= m_world.revision;
+
+    // tous les blocks sont a jour
+    for(unsigned int i= 0; i < m_world.dirty.size(); i++)
+    {
+        Block *block= m_world.find_block(m_world.dirty[i]);
+        if(block != NULL)
+            block->dirty= false;
+    }
+    m_world.dirty.clear();
+
+    return (int) m_meshes.size();
+}
+
+
+int GridMeshCache::commit( )
+{
+    std::vector<Result> results;
+    SDL_LockMutex(m_lock);
+    results.swap(m_results);
+    SDL_UnlockMutex(m_lock);
+
+    int count= 0;
+    for(unsigned int i= 0; i < results.size(); i++)
+    {
+        const Result& result= results[i];
+        std::map<int, unsigned int>::iterator generation= m_generations.find(result.key);
+        if(generation == m_generations.end() || generation->second != result.generation)
+        {
+            // le block a ete modifie depuis, une autre reconstruction est en cours
+            delete result.mesh;
+            continue;
+        }
+
+        m_generations.erase(generation);
+
+        std::map<int, gk::Mesh *>::iterator found= m_meshes.find(result.key);
+        if(found != m_meshes.end())
+        {
+            delete found->second;
+            if(result.mesh != NULL)
+                found->second= result.mesh;
+            else
+                m_meshes.erase(found);
+        }
+        else if(result.mesh != NULL)
+            m_meshes[result.key]= result.mesh;
+
+        count++;
+    }
+
+    return count;
+}
+
+void GridMeshCache::discard( )
+{
+    for(std::map<int, gk::Mesh *>::iterator it= m_meshes.begin(); it != m_meshes.end(); )
+    {
+        if(m_world.find_block(it->first) != NULL)
+        {
+            ++it;
+            continue;
+        }
+
+        // les faces des blocks voisins sont peut etre visibles maintenant, cf World::block_key()
+        const unsigned int key= (unsigned int) it->first;
+        const Gridpoint p(int(key >> 16) * 16 - 32768, int((key >> 12) & 15u) * 16, int(key & 4095u) * 16 - 32768);
+        const Gridpoint neighbours[6]=
+        {
+            Gridpoint(p.x -16, p.y, p.z), Gridpoint(p.x +16, p.y, p.z),
+            Gridpoint(p.x, p.y -16, p.z), Gridpoint(p.x, p.y +16, p.z),
+            Gridpoint(p.x, p.y, p.z -16), Gridpoint(p.x, p.y, p.z +16)
+        };
+        for(int i= 0; i < 6; i++)
+        {
+            const int nkey= World::block_key(neighbours[i]);
+            Block *n= (nkey < 0) ? NULL : m_world.find_block(nkey);
+            if(n == NULL || n->dirty)
+                continue;
+
+            n->dirty= true;
+            m_world.dirty.push_back(nkey);
+        }
+
+        m_generations.erase(it->first);
+        delete it->second;
+        m_meshes.erase(it++);
+    }
+}
+
+int GridMeshCache::update( )
+{
+    // les regions ont change, cf World::insert() et World::remove()
+    if(m_revision != m_world.revision)
+    {
+        discard();
+        m_revision= m_world.revision;
+    }
+
+    // copie les voxels des blocks modifies
+    std::vector<Job> jobs;
+    for(unsigned int i= 0; i < m_world.dirty.size(); i++)
+    {
+        const int key= m_world.dirty[i];
+        Block *block= m_world.find_block(key);
+        if(block == NULL)
+            continue;
+
+        block->dirty= false;
+
+        BlockVoxels *voxels= new BlockVoxels;
+        voxels->read(m_world, *block);
+
+        m_generation++;
+        m_generations[key]= m_generation;
+        jobs.push_back( Job(key, m_generation, voxels) );
+    }
+    m_world.dirty.clear();
+
+    if(m_thread == NULL)
+    {
+        // pas de thread de construction, reconstruit les blocks directement
+        for(unsigned int i= 0; i < jobs.size(); i++)
+        {
+            gk::Mesh *mesh= buildBlockMesh(*jobs[i].voxels);
+            delete jobs[i].voxels;
+            m_results.push_back( Result(jobs[i].key, jobs[i].generation, mesh) );
+        }
+    }
+    else if(jobs.empty() == false)
+    {
+        SDL_LockMutex(m_lock);
+        m_jobs.insert(m_jobs.end(), jobs.begin(), jobs.end());
+        SDL_CondSignal(m_wakeup);
+        SDL_UnlockMutex(m_lock);
+    }
+
+    // remplace les meshs reconstruits
+    return commit();
+}
+
+int GridMeshCache::flush( )
+{
+    SDL_LockMutex(m_lock);
+    while(m_thread != NULL && (m_jobs.empty() == false || m_busy > 0))
+        SDL_CondWait(m_done, m_lock);
+    SDL_UnlockMutex(m_lock);
+
+    return commit();
+}
+
+const gk::Mesh *GridMeshCache::mesh( const int key ) const
+{
+    std::map<int, gk::Mesh *>::const_iterator found= m_meshes.find(key);
+    if(found == m_meshes.end())
+        return NULL;
+    return found->second;
+}
+
+int GridMeshCache::pending( )
+{
+    SDL_LockMutex(m_lock);
+    int n= (int) m_jobs.size() + m_busy;
+    SDL_UnlockMutex(m_lock);
+    return n;
+}
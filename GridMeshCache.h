@@ -0,0 +1,107 @@
+
+#ifndef _GRID_MESH_CACHE_H
+#define _GRID_MESH_CACHE_H
+
+#include <map>
+#include <deque>
+#include <vector>
+
+#include "SDLPlatform.h"
+#include "GridMesh.h"
+
+
+/*! conserve les meshs des blocks du monde et reconstruit, en arriere plan, les meshs des blocks modifies.
+
+ exemple :
+ \code
+    World world;
+    GridMeshCache meshes(world);
+    meshes.build();                     // construit les meshs de tous les blocks
+
+    // a chaque image :
+    world.set(p, 0);                    // modifie un voxel, cf World::set()
+    meshes.update();                    // demande la reconstruction des blocks modifies, remplace les meshs reconstruits
+    ... meshes.mesh(key) ...
+ \endcode
+
+ update() doit etre appele par le thread qui modifie le monde : les voxels des blocks modifies sont copies par update(),
+ le thread de construction ne lit jamais le monde. les meshs reconstruits ne sont remplaces que dans update(),
+ un mesh renvoye par mesh() reste valide jusqu'au prochain appel.
+ */
+class GridMeshCache
+{
+    // non copyable
+    GridMeshCache( const GridMeshCache& );
+    GridMeshCache& operator= ( const GridMeshCache& );
+
+protected:
+    //! block a reconstruire.
+    struct Job
+    {
+        int key;
+        unsigned int generation;
+        BlockVoxels *voxels;
+
+        Job( const int _key, const unsigned int _generation, BlockVoxels *_voxels ) : key(_key), generation(_generation), voxels(_voxels) {}
+    };
+
+    //! mesh reconstruit.
+    struct Result
+    {
+        int key;
+        unsigned int generation;
+        gk::Mesh *mesh;
+
+        Result( const int _key, const unsigned int _generation, gk::Mesh *_mesh ) : key(_key), generation(_generation), mesh(_mesh) {}
+    };
+
+    World& m_world;
+    std::map<int, gk::Mesh *> m_meshes;                 //!< mesh de chaque block, cf World::block_key().
+    std::map<int, unsigned int> m_generations;          //!< derniere reconstruction demandee pour chaque block.
+    unsigned int m_generation;
+    unsigned int m_revision;                            //!< World::revision lors du dernier appel a build() ou update().
+
+    // partage avec le thread de construction, protege par m_lock
+    std::deque<Job> m_jobs;
+    std::vector<Result> m_results;
+    int m_busy;
+    bool m_stop;
+
+    SDL_Thread *m_thread;
+    SDL_mutex *m_lock;
+    SDL_cond *m_wakeup;         //!< signale un nouveau block a reconstruire.
+    SDL_cond *m_done;           //!< signale la fin d'une reconstruction.
+
+    static int builder( void *data );
+
+    int commit( );
+    //! detruit les meshs des blocks retires du monde, cf World::remove(), et marque leurs voisins comme modifies.
+    void discard( );
+
+public:
+    //! constructeur.
+    GridMeshCache( World& world );
+    //! destructeur. detruit les meshs.
+    ~GridMeshCache( );
+
+    //! construit les meshs de tous les blocks du monde, cf buildWorldMeshes(). les reconstructions en cours sont abandonnees.
+    int build( );
+
+    //! copie les voxels des blocks modifies, cf World::dirty, et demande leur reconstruction, ou les reconstruit directement si le thread n'a pas pu etre cree.
+    //! remplace les meshs des blocks reconstruits depuis le dernier appel. renvoie le nombre de meshs remplaces.
+    int update( );
+
+    //! attend la fin de toutes les reconstructions demandees, et remplace les meshs.
+    int flush( );
+
+    //! renvoie le mesh d'un block, ou NULL si le block n'a pas de faces visibles.
+    const gk::Mesh *mesh( const int key ) const;
+
+    //! renvoie l'ensemble des meshs.
+    const std::map<int, gk::Mesh *>& meshes( ) const { return m_meshes; }
+
+    //! renvoie le nombre de blocks en cours de reconstruction.
+    int pending( );
+};
+
+#endif
@@ -0,0 +1,262 @@
+
+#include <cstdio>
+#include <algorithm>
+
+#include "RegionCache.h"
+
+
+RegionCache::RegionCache( World& world, const size_t budget )
+    :
+    m_world(world), m_entries(), m_stats(), m_frame(0),
+    m_requests(), m_results(), m_busy(0), m_stop(false),
+    m_thread(NULL), m_lock(NULL), m_wakeup(NULL), m_done(NULL)
+{
+    m_stats.budget= budget;
+
+    m_lock= SDL_CreateMutex();
+    m_wakeup= SDL_CreateCond();
+    m_done= SDL_CreateCond();
+    m_thread= SDL_CreateThread(loader, "region loader", this);
+    if(m_thread == NULL)
+        printf("region cache: error creating loader thread.\n");
+}
+
+RegionCache::~RegionCache( )
+{
+    SDL_LockMutex(m_lock);
+    m_stop= true;
+    SDL_CondSignal(m_wakeup);
+    SDL_UnlockMutex(m_lock);
+
+    SDL_WaitThread(m_thread, NULL);
+
+    // les regions chargees mais pas encore inserees dans le monde sont perdues
+    for(unsigned int i= 0; i < m_results.size(); i++)
+        delete m_results[i].region;
+
+    SDL_DestroyCond(m_done);
+    SDL_DestroyCond(m_wakeup);
+    SDL_DestroyMutex(m_lock);
+}
+
+
+int RegionCache::loader( void *data )
+{
+    RegionCache *cache= (RegionCache *) data;
+
+    SDL_LockMutex(cache->m_lock);
+    for(;;)
+    {
+        while(cache->m_stop == false && cache->m_requests.empty())
+            SDL_CondWait(cache->m_wakeup, cache->m_lock);
+        if(cache->m_stop)
+            break;
+
+        int id= cache->m_requests.front();
+        cache->m_requests.pop_front();
+        std::string filename= cache->m_entries[id].filename;
+        cache->m_busy++;
+        SDL_UnlockMutex(cache->m_lock);
+
+        // charge la region, sans modifier le monde
+        Uint64 start= SDL_GetPerformanceCounter();
+        Region *region= new Region;
+        if(region->read(filename) < 0)
+        {
+            delete region;
+            region= NULL;
+        }
+        double time= (double) (SDL_GetPerformanceCounter() - start) / (double) SDL_GetPerformanceFrequency();
+
+        SDL_LockMutex(cache->m_lock);
+        cache->m_results.push_back( Result(id, region, time) );
+        cache->m_busy--;
+        SDL_CondSignal(cache->m_done);
+    }
+    SDL_UnlockMutex(cache->m_lock);
+
+    return 0;
+}
+
+
+int RegionCache::open( const std::string& pathname )
+{
+    std::string filename= pathname + ".txt";
+    printf("region cache: reading map '%s'...\n", filename.c_str());
+
+    FILE *in= fopen(filename.c_str(), "rt");
+    if(in == NULL)
+    {
+        printf("region cache: reading map '%s'... failed\n", filename.c_str());
+        return -1;
+    }
+
+    SDL_LockMutex(m_lock);
+    char tmp[1024];
+    for(;;)
+    {
+        if(fscanf(in, " %[^\r\n] ", tmp) != 1)
+            break;
+
+        if(tmp[0] == '#')
+            // saute les commentaires
+            continue;
+
+        int x, z;
+        if(sscanf(tmp, "%*[^.].%d.%d.gkmc", &x, &z) != 2)
+        {
+            printf("region cache: invalid region '%s'.\n", tmp);
+            continue;
+        }
+
+        m_entries.push_back( Entry(pathname + "/" + tmp, Gridpoint(x*256, 0, z*256)) );
+    }
+    SDL_UnlockMutex(m_lock);
+
+    fclose(in);
+    printf("  %u regions.\n", (unsigned int) m_entries.size());
+    return 0;
+}
+
+
+int RegionCache::commit( )
+{
+    std::vector<Result> results;
+    SDL_LockMutex(m_lock);
+    results.swap(m_results);
+    m_stats.pending= (int) m_requests.size() + m_busy;
+    SDL_UnlockMutex(m_lock);
+
+    for(unsigned int i= 0; i < results.size(); i++)
+    {
+        Entry& entry= m_entries[results[i].entry];
+        Region *region= results[i].region;
+        m_stats.load_time+= results[i].time;
+
+        size_t memory= (region != NULL) ? region->memory() : 0;
+        if(region == NULL || m_world.insert(*region) < 0)
+        {
+            // ne pas recharger la region a chaque image
+            entry.state= FAILED;
+            m_stats.failures++;
+            delete region;
+            continue;
+        }
+
+        delete region;
+        entry.state= RESIDENT;
+        entry.last_use= m_frame;
+        entry.memory= memory;
+        m_stats.memory+= memory;
+        m_stats.resident++;
+        m_stats.loads++;
+    }
+
+    return (int) results.size();
+}
+
+int RegionCache::evict( const int id )
+{
+    Entry& entry= m_entries[id];
+    assert(entry.state == RESIDENT);
+    if(m_world.remove(entry.pmin) < 0)
+        return -1;
+
+    entry.state= ABSENT;
+    m_stats.memory-= entry.memory;
+    entry.memory= 0;
+    m_stats.resident--;
+    m_stats.evictions++;
+    return 0;
+}
+
+
+int RegionCache::update( const Gridpoint& viewpoint, const int radius )
+{
+    m_frame++;
+
+    // insere les regions chargees dans le monde
+    commit();
+
+    // selectionne les regions proches du point de vue, distance dans le plan xz
+    const long int r2= (long int) radius * radius;
+    std::vector< std::pair<long int, int> > wanted;
+    for(unsigned int i= 0; i < m_entries.size(); i++)
+    {
+        Entry& entry= m_entries[i];
+        long int dx= std::max(0, std::max(entry.pmin.x - viewpoint.x, viewpoint.x - (entry.pmin.x + 255)));
+        long int dz= std::max(0, std::max(entry.pmin.z - viewpoint.z, viewpoint.z - (entry.pmin.z + 255)));
+        long int d2= dx*dx + dz*dz;
+        if(d2 > r2)
+            continue;
+
+        if(entry.state == RESIDENT)
+            entry.last_use= m_frame;
+        else if(entry.state == ABSENT || entry.state == PENDING)
+            wanted.push_back( std::make_pair(d2, (int) i) );
+    }
+
+    // charge les regions les plus proches en premier
+    std::sort(wanted.begin(), wanted.end());
+
+    SDL_LockMutex(m_lock);
+    {
+        // les demandes precedentes, qui ne sont plus necessaires, sont annulees
+        std::vector<bool> queued(m_entries.size(), false);
+        for(unsigned int i= 0; i < m_requests.size(); i++)
+            queued[m_requests[i]]= true;
+
+        std::deque<int> requests;
+        for(unsigned int i= 0; i < wanted.size(); i++)
+        {
+            int id= wanted[i].second;
+            if(m_entries[id].state == ABSENT)
+            {
+                m_entries[id].state= PENDING;
+                m_stats.requests++;
+                requests.push_back(id);
+            }
+            else if(queued[id])
+            {
+                queued[id]= false;
+                requests.push_back(id);
+            }
+            // sinon, la region est en cours de chargement
+        }
+
+        for(unsigned int i= 0; i < queued.size(); i++)
+            if(queued[i])
+                m_entries[i].state= ABSENT;
+
+        m_requests.swap(requests);
+        m_stats.pending= (int) m_requests.size() + m_busy;
+        if(m_requests.empty() == false)
+            SDL_CondSignal(m_wakeup);
+    }
+    SDL_UnlockMutex(m_lock);
+
+    // retire les regions les moins recemment utilisees, sauf celles proches du point de vue
+    while(m_stats.memory > m_stats.budget)
+    {
+        int lru= -1;
+        for(unsigned int i= 0; i < m_entries.size(); i++)
+            if(m_entries[i].state == RESIDENT && m_entries[i].last_use != m_frame
+            && (lru < 0 || m_entries[i].last_use < m_entries[lru].last_use))
+                lru= (int) i;
+
+        if(lru < 0 || evict(lru) < 0)
+            break;      // toutes les regions presentes sont utilisees...
+    }
+
+    return 0;
+}
+
+int RegionCache::flush( )
+{
+    SDL_LockMutex(m_lock);
+    while(m_requests.empty() == false || m_busy > 0)
+        SDL_CondWait(m_done, m_lock);
+    SDL_UnlockMutex(m_lock);
+
+    return commit();
+}
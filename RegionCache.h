@@ -0,0 +1,125 @@
+
+#ifndef _REGION_CACHE_H
+#define _REGION_CACHE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+
+#include "SDLPlatform.h"
+#include "Grid.h"
+
+
+//! statistiques du cache de regions.
+struct RegionCacheStats
+{
+    int requests;               //!< nombre de demandes de chargement.
+    int loads;                  //!< nombre de regions chargees.
+    int failures;               //!< nombre d'echecs de chargement.
+    int evictions;              //!< nombre de regions retirees du monde.
+    int resident;               //!< nombre de regions presentes dans le monde.
+    int pending;                //!< nombre de regions en attente de chargement.
+    size_t memory;              //!< taille occupee par les regions presentes, en octets.
+    size_t budget;              //!< taille maximale occupee par les regions.
+    double load_time;           //!< temps total de chargement, en secondes.
+
+    RegionCacheStats( ) : requests(0), loads(0), failures(0), evictions(0), resident(0), pending(0), memory(0), budget(0), load_time(0) {}
+};
+
+
+/*! chargement progressif des regions d'une map autour d'un point de vue.
+ les regions sont chargees par un thread, en arriere plan, et inserees dans le monde par update().
+ les regions les moins recemment utilisees sont retirees du monde lorsque le budget memoire est depasse.
+
+ exemple :
+ \code
+    World world;
+    RegionCache cache(world, 512*1024*1024);
+    cache.open("map");   // liste les regions de map.txt, sans les charger
+
+    // a chaque image :
+    cache.update(Gridpoint(x, y, z), 1024);      // charge les regions a moins de 1024 voxels du point de vue
+    ... world.voxel(p) ...
+ \endcode
+
+ update() modifie le monde : les pointeurs sur les maps, regions, blocks, ainsi que les GridCache, sont invalides.
+ */
+class RegionCache
+{
+    // non copyable
+    RegionCache( const RegionCache& );
+    RegionCache& operator= ( const RegionCache& );
+
+protected:
+    //! etat d'une region de la map.
+    struct Entry
+    {
+        std::string filename;   //!< fichier .gkmc
+        Gridpoint pmin;         //!< coin de la region dans le monde.
+        int state;              //!< ABSENT, PENDING, RESIDENT ou FAILED.
+        unsigned int last_use;  //!< date de la derniere utilisation, cf m_frame.
+        size_t memory;          //!< taille de la region, si elle est presente.
+
+        Entry( const std::string& _filename, const Gridpoint& _pmin ) : filename(_filename), pmin(_pmin), state(ABSENT), last_use(0), memory(0) {}
+    };
+
+    //! region chargee par le thread, en attente d'insertion dans le monde.
+    struct Result
+    {
+        int entry;
+        Region *region;         //!< NULL en cas d'echec.
+        double time;
+
+        Result( const int _entry, Region *_region, const double _time ) : entry(_entry), region(_region), time(_time) {}
+    };
+
+    enum
+    {
+        ABSENT= 0,
+        PENDING,
+        RESIDENT,
+        FAILED
+    };
+
+    World& m_world;
+    std::vector<Entry> m_entries;
+    RegionCacheStats m_stats;
+    unsigned int m_frame;
+
+    // partage avec le thread de chargement, protege par m_lock
+    std::deque<int> m_requests;
+    std::vector<Result> m_results;
+    int m_busy;
+    bool m_stop;
+
+    SDL_Thread *m_thread;
+    SDL_mutex *m_lock;
+    SDL_cond *m_wakeup;         //!< signale une nouvelle demande au thread de chargement.
+    SDL_cond *m_done;           //!< signale la fin d'un chargement.
+
+    static int loader( void *data );
+
+    int commit( );
+    int evict( const int id );
+
+public:
+    //! constructeur. budget : taille maximale occupee par les regions, en octets.
+    RegionCache( World& world, const size_t budget );
+    //! destructeur, arrete le thread de chargement. les regions restent dans le monde.
+    ~RegionCache( );
+
+    //! liste les regions d'une map, sans les charger, cf World::loadMap().
+    int open( const std::string& pathname );
+
+    //! charge les regions a moins de radius voxels de viewpoint, insere les regions chargees dans le monde,
+    //! et retire les regions les moins recemment utilisees si le budget est depasse.
+    int update( const Gridpoint& viewpoint, const int radius );
+
+    //! attend le chargement de toutes les regions demandees, et les insere dans le monde.
+    int flush( );
+
+    //! renvoie les statistiques de chargement et d'occupation.
+    const RegionCacheStats& stats( ) const { return m_stats; }
+};
+
+#endif
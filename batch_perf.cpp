@@ -9,6 +9,9 @@
 
 #include "Mesh.h"
 #include "MeshIO.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshCluster.h"
 
 #include "GL/GLTexture.h"
 #include "GL/GLQuery.h"
@@ -41,11 +44,20 @@ class Batch : public gk::App
     std::vector<int> m_cpu_graph;
     std::vector<DrawElementsIndirect> m_elements_indirect;
     
+    std::vector<gk::MeshLOD> m_lods;
+    std::vector<unsigned int> m_lod_offsets;    // premier indice de chaque niveau de detail dans l'index buffer
+    gk::BBox m_bbox;
+    
+    std::vector<gk::MeshCluster> m_clusters;
+    std::vector<unsigned int> m_visible_clusters;
+    
     float m_scale;
     int m_draw_count;
     bool m_draw_degenerate;
     
     bool m_multi_draw;
+    bool m_use_lods;
+    bool m_cull_clusters;
     bool m_static_vao;
     bool m_change_mesh;
     bool m_change_shader;
@@ -113,35 +125,59 @@ public:
         gk::Mesh *mesh= gk::MeshIO::readOBJ("bigguy.obj");
         if(mesh == NULL)
             return -1;
+        
+        // reordonne les triangles et les sommets pour les caches du gpu
+        gk::MeshOptimizer::optimize(mesh);
     
+        // decoupe le mesh en clusters, pour eliminer les triangles non visibles
+        gk::MeshClusters::build(mesh, m_clusters);
+        
+        // le decoupage reordonne les triangles, les optimise a nouveau pour le cache, a l'interieur de chaque cluster
+        gk::MeshOptimizer::optimizeVertexCache(mesh, m_clusters);
+        gk::MeshOptimizer::optimizeVertexFetch(mesh);
+        printf("clusters... ACMR %.3f\n", gk::MeshOptimizer::ACMR(mesh));
+        
+        // niveaux de detail, ranges les uns a la suite des autres dans le meme index buffer
+        gk::MeshSimplifier::buildLODs(mesh, m_lods);
+        std::vector<unsigned int> indices;
+        for(unsigned int i= 0; i < m_lods.size(); i++)
+        {
+            m_lod_offsets.push_back(indices.size());
+            indices.insert(indices.end(), m_lods[i].indices.begin(), m_lods[i].indices.end());
+        }
+        m_lod_offsets.push_back(indices.size());
+        
+        for(unsigned int i= 0; i < mesh->positions.size(); i++)
+            m_bbox.Union(gk::Point(mesh->positions[i]));
+        
         // cree 2 objets
         m_mesh[0]= new gk::GLBasicMesh(GL_TRIANGLES, mesh->indices.size());
         m_mesh[0]->createBuffer(0, mesh->positions);
         m_mesh[0]->createBuffer(1, mesh->texcoords);
         m_mesh[0]->createBuffer(2, mesh->normals);
-        m_mesh[0]->createIndexBuffer(mesh->indices);
+        m_mesh[0]->createIndexBuffer(indices);
         
         m_mesh[1]= new gk::GLBasicMesh(GL_TRIANGLES, mesh->indices.size());
         m_mesh[1]->createBuffer(0, mesh->positions);
         m_mesh[1]->createBuffer(1, mesh->texcoords);
         m_mesh[1]->createBuffer(2, mesh->normals);
-        m_mesh[1]->createIndexBuffer(mesh->indices);
+        m_mesh[1]->createIndexBuffer(indices);
         
         // cree 2 objets degeneres, meme nombre de triangles
-        for(unsigned int i= 1; i < mesh->indices.size(); i++)
-            mesh->indices[i]= mesh->indices[0]; // tous les triangles referencent le meme sommet
+        for(unsigned int i= 1; i < indices.size(); i++)
+            indices[i]= indices[0]; // tous les triangles referencent le meme sommet
         
         m_mesh[2]= new gk::GLBasicMesh(GL_TRIANGLES, mesh->indices.size());
         m_mesh[2]->createBuffer(0, mesh->positions);
         m_mesh[2]->createBuffer(1, mesh->texcoords);
         m_mesh[2]->createBuffer(2, mesh->normals);
-        m_mesh[2]->createIndexBuffer(mesh->indices);
+        m_mesh[2]->createIndexBuffer(indices);
         
         m_mesh[3]= new gk::GLBasicMesh(GL_TRIANGLES, mesh->indices.size());
         m_mesh[3]->createBuffer(0, mesh->positions);
         m_mesh[3]->createBuffer(1, mesh->texcoords);
         m_mesh[3]->createBuffer(2, mesh->normals);
-        m_mesh[3]->createIndexBuffer(mesh->indices);
+        m_mesh[3]->createIndexBuffer(indices);
         
         // vao
         m_vao= gk::createVertexArray();
@@ -166,6 +202,8 @@ public:
         
         m_static_vao= true;
         m_multi_draw= false;
+        m_use_lods= false;
+        m_cull_clusters= false;
         
         return 0;
     }
@@ -205,6 +243,13 @@ public:
         gk::Transform mv= view * model;
         gk::Transform mvp= perspective * mv;
         
+        // selectionne le niveau de detail en fonction de la taille de l'objet a l'ecran
+        int lod= 0;
+        if(m_use_lods)
+            lod= gk::MeshSimplifier::selectLOD(m_lods, m_bbox, mvp, windowWidth(), windowHeight());
+        const unsigned int lod_begin= m_lod_offsets[lod];
+        const unsigned int lod_count= m_lod_offsets[lod +1] - m_lod_offsets[lod];
+        
         m_time->begin();
         GLint64 start; glGetInteger64v(GL_TIMESTAMP, &start);
         
@@ -224,12 +269,28 @@ public:
             m_program[program_id]->uniform("normalMatrix")= mv.normalMatrix();
             m_program[program_id]->uniform("color")= gk::Vec4(1.f, 1.f, 1.f);            
             
-            DrawElementsIndirect draw(m_mesh[mesh_id]->count);
-            m_elements_indirect.assign(m_draw_count, draw);
+            m_elements_indirect.clear();
+            if(m_cull_clusters && lod == 0)
+            {
+                // 1 draw par sequence de clusters visibles, les clusters sont ranges dans l'index buffer du lod 0
+                gk::MeshClusters::cull(m_clusters, mvp, m_visible_clusters);
+                for(int i= 0; i < m_draw_count; i++)
+                for(unsigned int k= 0; k < m_visible_clusters.size(); k++)
+                {
+                    const gk::MeshCluster& cluster= m_clusters[m_visible_clusters[k]];
+                    if(k > 0 && m_elements_indirect.back().baseIndex + m_elements_indirect.back().count == cluster.begin)
+                        m_elements_indirect.back().count+= cluster.end - cluster.begin;
+                    else
+                        m_elements_indirect.push_back( DrawElementsIndirect(cluster.end - cluster.begin, 1, cluster.begin) );
+                }
+            }
+            else
+                m_elements_indirect.assign(m_draw_count, DrawElementsIndirect(lod_count, 1, lod_begin));
             
             glBindVertexArray(m_mesh[mesh_id]->vao->name);
-            glMultiDrawElementsIndirect(m_mesh[mesh_id]->primitive, m_mesh[mesh_id]->index_type, 
-                &m_elements_indirect.front(), m_elements_indirect.size(), sizeof(DrawElementsIndirect));
+            if(!m_elements_indirect.empty())
+                glMultiDrawElementsIndirect(m_mesh[mesh_id]->primitive, m_mesh[mesh_id]->index_type, 
+                    &m_elements_indirect.front(), m_elements_indirect.size(), sizeof(DrawElementsIndirect));
         }
         else
         {
@@ -300,7 +361,8 @@ public:
                 if(m_mesh[current_mesh]->index_type == 0u)
                     glDrawArrays(m_mesh[current_mesh]->primitive, 0, m_mesh[current_mesh]->count);
                 else
-                    glDrawElements(m_mesh[current_mesh]->primitive, m_mesh[current_mesh]->count, m_mesh[current_mesh]->index_type, 0);
+                    glDrawElements(m_mesh[current_mesh]->primitive, lod_count, m_mesh[current_mesh]->index_type, 
+                        (GLvoid *) (unsigned long int) (m_mesh[current_mesh]->index_sizeof * lod_begin));
             }
         }
         
@@ -336,6 +398,17 @@ public:
             m_widgets.doButton(nv::Rect(), "use static vao", &m_static_vao);
             //~ m_widgets.doLabel(nv::Rect(), "use bindless buffers");
             m_widgets.doButton(nv::Rect(), "use multi draw indirect", &m_multi_draw);
+            m_widgets.doButton(nv::Rect(), "use lods", &m_use_lods);
+            m_widgets.doButton(nv::Rect(), "cull clusters (multi draw)", &m_cull_clusters);
+            
+            sprintf(tmp, "lod %d, %u triangles", lod, lod_count / 3);
+            m_widgets.doLabel(nv::Rect(), tmp);
+            
+            if(m_cull_clusters && m_multi_draw && lod == 0)
+            {
+                sprintf(tmp, "%u/%u visible clusters", (unsigned int) m_visible_clusters.size(), (unsigned int) m_clusters.size());
+                m_widgets.doLabel(nv::Rect(), tmp);
+            }
         
             sprintf(tmp, "draw count %d", m_draw_count);
             m_widgets.doLabel(nv::Rect(), tmp);
@@ -1,4 +1,6 @@
 
+#include <cstddef>
+
 const char *block_names[] = 
 {
     "", // 0
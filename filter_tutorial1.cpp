@@ -5,6 +5,7 @@
 #include "Vec.h"
 #include "Geometry.h"
 #include "Image.h"
+#include "ImageView.h"
 #include "ImageIO.h"
 
 
@@ -33,46 +34,59 @@ struct Timer
 };
 
 
-//! renvoie 0 si les coordonnees sont en dehors de l'image.
-gk::Color border( const gk::Image * const in, const int x, const int y )
-{
-    if(x < 0 || x >= in->width) return gk::Color();
-    if(y < 0 || y >= in->height) return gk::Color();
-    return gk::Color(in->pixel(x, y));
-}
-
-
 //! filtre l'image.
 gk::Image *process( const gk::Image * const image, const gk::Image * const filter )
 {
+    // converti l'image et le filtre en rgba float, les boucles accedent directement aux pixels, sans conversion
+    gk::Image *in= gk::createImage(image->width, image->height);
+    gk::copyImage(in, image);
+    gk::Image *kernel= gk::createImage(filter->width, filter->height);
+    gk::copyImage(kernel, filter);
+    
     // cree l'image resultat de la meme taille que l'imag en entree
     gk::Image *out= gk::createImage(image->width, image->height);
     
+    const gk::ImageView<const float, 4> pixels(in);
+    const gk::ImageView<const float, 4> weights(kernel);
+    const gk::ImageView<float, 4> result(out);
+    
     // parcourir tous les pixels de l'image
     #pragma omp parallel for schedule(dynamic, 1)
-    for(int y= 0; y < image->height; y++)
-    for(int x= 0; x < image->width; x++)
+    for(int y= 0; y < pixels.height; y++)
+    for(int x= 0; x < pixels.width; x++)
     {
         // convolution du voisinage du pixel par le filtre
-        gk::Color r;
-        gk::Color norm;
-        for(int yy= 0; yy < filter->height; yy++)
-        for(int xx= 0; xx < filter->width; xx++)
+        float r[4]= { 0.f, 0.f, 0.f, 0.f };
+        float norm[4]= { 0.f, 0.f, 0.f, 0.f };
+        for(int yy= 0; yy < weights.height; yy++)
         {
-            // recupere un pixel 
-            gk::Color pixel= border(image, x + xx - filter->width/2, y + yy - filter->height/2);
-            // recupere la valeur du filtre
-            gk::Color f= border(filter, xx, yy);
+            // recupere les valeurs du filtre
+            const float *f= weights.row(yy);
             
-            // calculer
-            r+= pixel * f;
-            norm+= f;
+            // les pixels en dehors de l'image sont nuls, seul le filtre est accumule
+            const int py= y + yy - weights.height/2;
+            const bool inside= (py >= 0 && py < pixels.height);
+            const float *p= inside ? pixels.row(py) : NULL;
+            for(int xx= 0; xx < weights.width; xx++, f+= 4)
+            {
+                const int px= x + xx - weights.width/2;
+                if(inside && px >= 0 && px < pixels.width)
+                    for(int c= 0; c < 4; c++)
+                        r[c]+= p[4*px + c] * f[c];
+                
+                for(int c= 0; c < 4; c++)
+                    norm[c]+= f[c];
+            }
         }
         
         // ecrire le resultat
-        out->setPixel(x, y, r / norm);
+        float *o= result(x, y);
+        for(int c= 0; c < 4; c++)
+            o[c]= r[c] / norm[c];
     }
     
+    delete in;
+    delete kernel;
     return out;
 }
 
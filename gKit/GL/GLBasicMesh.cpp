@@ -1,5 +1,8 @@
 
+#include <cstddef>
+
 #include "Logger.h"
+#include "MeshPacking.h"
 
 #include "GL/GLBasicMesh.h"
 
@@ -64,6 +67,34 @@ GLBasicMesh& GLBasicMesh::createBuffer( const int index, const int item_size, co
     return *this;
 }
 
+GLBasicMesh& GLBasicMesh::createBuffer( const std::vector<PackedVertex>& data, const GLenum usage )
+{
+    if(data.empty())
+        return *this;
+    
+    if(buffers.empty())
+        buffers.resize(1, GLBuffer::null());
+    buffers[0]= gk::createBuffer(GL_ARRAY_BUFFER, data.size() * sizeof(PackedVertex), &data.front(), usage);
+
+#ifndef NDEBUG
+    {
+        GLint current;
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &current);
+        if((GLuint) current != vao->name)
+            ERROR("invalid vertex array %d, basic mesh %d\n", current, vao->name);
+    }
+#endif
+    
+    const GLsizei stride= sizeof(PackedVertex);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid *) offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, stride, (GLvoid *) offsetof(PackedVertex, texcoord));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, stride, (GLvoid *) offsetof(PackedVertex, normal));
+    glEnableVertexAttribArray(2);
+    return *this;
+}
+
 GLBasicMesh& GLBasicMesh::createIndexBuffer( const GLenum item_type, 
     const unsigned int length, const void *data, const GLenum usage  )
 {
@@ -10,6 +10,8 @@
 
 namespace gk {
 
+struct PackedVertex;
+
 namespace gl {
     template< typename T > inline GLenum type( ) {  assert(0 && "gl::type<T>( ): not defined"); return 0; }
     
@@ -62,6 +64,12 @@ public:
         return createBuffer(index, 4, gl::type<T>(), data.size() * sizeof(TVec4<T>), &data.front(), usage);
     }
     
+    /*! creation d'un buffer de sommets compresses, cf MeshPacking::pack(). un seul buffer entrelace, 
+        attribut 0 : position normalisee dans [0 1], a transformer par la bbox du mesh, 1 : texcoord, 2 : normale en encodage octaedrique.
+        cf shaders/packed.glsl pour le decodage.
+     */
+    GLBasicMesh& createBuffer( const std::vector<PackedVertex>& data, const GLenum usage= GL_STATIC_DRAW );
+    
     GLBasicMesh& createIndexBuffer( const GLenum item_type, 
         const unsigned int length, const void *data, const GLenum usage= GL_STATIC_DRAW );
     
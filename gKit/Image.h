@@ -4,9 +4,11 @@
 
 #include <cassert>
 #include <cstring>
+#include <algorithm>
 
 #include "Vec.h"
 #include "IOResource.h"
+#include "ImagePool.h"
 
 
 namespace gk {
@@ -17,6 +19,15 @@ class Image : public IOResource
     Image( const Image & );
     Image& operator=( const Image& );
 
+    //! rend les pixels au pool, sauf s'ils sont partages avec une autre image, cf reference().
+    void free_data( )
+    {
+        if(reference_data == false)
+            ImagePool::release(data);
+        data= NULL;
+        reference_data= false;
+    }
+
 protected:
     //! modifie la valeur d'un pixel.
     void setPixel( const unsigned int offset, const VecColor& color )
@@ -122,14 +133,46 @@ public:
         width(0), height(0), depth(0), channels(0), type(0), pixel_sizeof(0), data(NULL), reference_data(false)
     {}
     
+#if __cplusplus >= 201103L
+    //! constructeur par deplacement, recupere les pixels de image.
+    Image( Image&& image )
+        :
+        IOResource(image.resource),
+        width(0), height(0), depth(0), channels(0), type(0), pixel_sizeof(0), data(NULL), reference_data(false)
+    {
+        swap(image);
+    }
+
+    //! affectation par deplacement, echange les pixels avec image.
+    Image& operator=( Image&& image )
+    {
+        swap(image);
+        return *this;
+    }
+#endif
+
     //! destructeur.
     ~Image( )
     {
-        if(reference_data == false)
-            delete [] data;
+        free_data();
+    }
+
+    //! echange le contenu de 2 images, sans copier les pixels.
+    void swap( Image& image )
+    {
+        std::swap(resource, image.resource);
+        std::swap(released, image.released);
+        std::swap(width, image.width);
+        std::swap(height, image.height);
+        std::swap(depth, image.depth);
+        std::swap(channels, image.channels);
+        std::swap(type, image.type);
+        std::swap(pixel_sizeof, image.pixel_sizeof);
+        std::swap(data, image.data);
+        std::swap(reference_data, image.reference_data);
     }
     
-    //! construction d'une image de dimension wxh. 
+    //! construction d'une image de dimension wxh. les pixels sont alignes sur ImagePool::ALIGNMENT octets et recycles par ImagePool.
     Image *create( const int _w, const int _h, const int _channels, const unsigned int _type, void *_data= NULL )
     {
         width= _w;
@@ -138,6 +181,7 @@ public:
         channels= _channels;
         type= _type;
         released= false;
+        free_data();
         
         switch(type)
         {
@@ -147,8 +191,8 @@ public:
                 assert(0 && "invalid image type");
         }
         
-        int length= width * height * pixel_sizeof * channels;
-        data= new unsigned char[length];
+        const size_t length= (size_t) width * height * pixel_sizeof * channels;
+        data= ImagePool::allocate(length);
         if(_data != NULL)
             memcpy(data, _data, length);
         
@@ -164,6 +208,7 @@ public:
         channels= _channels;
         type= _type;
         released= false;
+        free_data();
         
         switch(type)
         {
@@ -173,8 +218,8 @@ public:
                 assert(0 && "invalid image type");
         }
         
-        int length= width * height * depth * pixel_sizeof * channels;
-        data= new unsigned char[length];
+        const size_t length= (size_t) width * height * depth * pixel_sizeof * channels;
+        data= ImagePool::allocate(length);
         if(_data != NULL)
             memcpy(data, _data, length);
         
@@ -186,6 +231,7 @@ public:
         if(image == NULL)
             return this;
         
+        free_data();
         width= image->width;
         height= image->height;
         depth= image->depth;
@@ -202,9 +248,7 @@ public:
     //! destruction des donnees de l'image / de la ressource.
     void release( )
     {
-        if(reference_data == false)
-            delete [] data;
-        data= NULL;
+        free_data();
         released= true;
     }
     
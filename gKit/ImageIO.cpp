@@ -2,6 +2,7 @@
 #include "SDLImagePlatform.h"
 
 #include "Image.h"
+#include "ImageView.h"
 #include "ImageArray.h"
 #include "ImageIO.h"
 
@@ -87,38 +88,40 @@ Image *readImage( const std::string& filename )
             return NULL;
         
         // converti les donnees en pixel rgba, retourne l'image, openGL utilise une origine en bas a gauche.
-        Uint8 *p= (Uint8 *) surface->pixels;
-        int py= 0;
+        const int r= format.Rshift / 8;
+        const int g= format.Gshift / 8;
+        const int b= format.Bshift / 8;
+        const int a= format.Ashift / 8;
         
         if(format.BitsPerPixel == 32)
         {
-            for(int y= height -1; y >= 0; y--, py++)
+            ImageView<unsigned char, 4> pixels(image);
+            for(int y= 0; y < height; y++)
             {
-                p= (Uint8 *) surface->pixels + py * surface->pitch;
-                for(int x= 0; x < width; x++, p+= format.BytesPerPixel)
+                const Uint8 *p= (const Uint8 *) surface->pixels + y * surface->pitch;
+                unsigned char *q= pixels.row(height - y -1);
+                for(int x= 0; x < width; x++, p+= 4, q+= 4)
                 {
-                    const Uint8 r= p[format.Rshift / 8];
-                    const Uint8 g= p[format.Gshift / 8];
-                    const Uint8 b= p[format.Bshift / 8];
-                    const Uint8 a= p[format.Ashift / 8];
-                    
-                    image->setPixel(x, y, VecColor(r / 255.f, g / 255.f, b / 255.f, a / 255.f));
+                    q[0]= p[r];
+                    q[1]= p[g];
+                    q[2]= p[b];
+                    q[3]= p[a];
                 }
             }
         }
         
         else if(format.BitsPerPixel == 24)
         {
-            for(int y= height -1; y >= 0; y--, py++)
+            ImageView<unsigned char, 3> pixels(image);
+            for(int y= 0; y < height; y++)
             {
-                p= (Uint8 *) surface->pixels + py * surface->pitch;
-                for(int x= 0; x < width; x++, p+= format.BytesPerPixel)
+                const Uint8 *p= (const Uint8 *) surface->pixels + y * surface->pitch;
+                unsigned char *q= pixels.row(height - y -1);
+                for(int x= 0; x < width; x++, p+= 3, q+= 3)
                 {
-                    const Uint8 r= p[format.Rshift / 8];
-                    const Uint8 g= p[format.Gshift / 8];
-                    const Uint8 b= p[format.Bshift / 8];
-                    
-                    image->setPixel(x, y, VecColor(r / 255.f, g / 255.f, b / 255.f));
+                    q[0]= p[r];
+                    q[1]= p[g];
+                    q[2]= p[b];
                 }
             }
         }
@@ -147,11 +150,17 @@ Image *readImage( const std::string& filename )
             return NULL;
         }
         
-        Image *flip= (new Image())->create(width, height, 3, Image::FLOAT);
-        if(RGBE_ReadPixels_RLE(in, (float *) flip->data, width, height) != RGBE_RETURN_SUCCESS)
+        image= (new Image(filename))->create(width, height, 3, Image::FLOAT);
+        if(image == NULL)
         {
             fclose(in);
-            delete flip;
+            return NULL;
+        }
+        
+        if(RGBE_ReadPixels_RLE(in, (float *) image->data, width, height) != RGBE_RETURN_SUCCESS)
+        {
+            fclose(in);
+            delete image;
             
             ERROR("loading hdr image '%s'... failed.\n", filename.c_str());
             return NULL;
@@ -159,16 +168,8 @@ Image *readImage( const std::string& filename )
         
         fclose(in);
         
-        // converti les donnees en pixels hdr, retourne l'image, openGL utilise une origine en bas a gauche.
-        image= (new Image(filename))->create(width, height, 3, Image::FLOAT);
-        if(image == NULL)
-            return NULL;
-        
-        for(int y= 0; y < image->height; y++)
-        for(int x= 0; x < image->width; x++)
-            image->setPixel(x, image->height - y -1, flip->pixel(x, y));
-        
-        delete flip;
+        // retourne l'image sur place, openGL utilise une origine en bas a gauche.
+        flipImage(image);
     }
     
 #ifdef GK_OPENEXR
@@ -218,10 +219,19 @@ Image *readImage( const std::string& filename )
         file.readPixels(dw.min.y, dw.max.y);
         
         image= (new Image(filename))->create(width, height, 4, Image::FLOAT);
-        Rgba *p= pixels[0];
+        ImageView<float, 4> view(image);
+        const Rgba *p= pixels[0];
         for(int y= height -1; y >= 0; y--)
-        for(int x= 0; x < width; x++, p++)
-            image->setPixel(x, y, VecColor((float) p[0].r, (float) p[0].g, (float)p[0].b));
+        {
+            float *q= view.row(y);
+            for(int x= 0; x < width; x++, p++, q+= 4)
+            {
+                q[0]= (float) p->r;
+                q[1]= (float) p->g;
+                q[2]= (float) p->b;
+                q[3]= 1.f;
+            }
+        }
     }
 #endif
     
@@ -262,13 +272,12 @@ int writeImage( const std::string& filename, Image *image )
     {
         MESSAGE("writing color image '%s'...\n", filename.c_str());
         
-        // flip de l'image : Y inverse entre GL et BMP
-        Image *flip= (new Image())->create(image->width, image->height, 4, Image::UNSIGNED_BYTE);
-        for(int y= 0; y < image->height; y++)
-        for(int x= 0; x < image->width; x++)
-            flip->setPixel(x, image->height - y -1, image->pixel(x, y));
+        // flip de l'image : Y inverse entre GL et BMP, les pixels temporaires sont recycles par ImagePool
+        Image flip;
+        flip.create(image->width, image->height, 4, Image::UNSIGNED_BYTE);
+        copyImage(&flip, image, true);
         
-        SDL_Surface *bmp= SDL_CreateRGBSurfaceFrom((void *) flip->data, 
+        SDL_Surface *bmp= SDL_CreateRGBSurfaceFrom((void *) flip.data, 
             image->width, image->height, 
             32, image->width * 4, 
     #if 0
@@ -295,7 +304,6 @@ int writeImage( const std::string& filename, Image *image )
             ERROR("invalid image format. failed.\n");
         
         SDL_FreeSurface(bmp);
-        delete flip;
         return code;
     }
     
@@ -321,14 +329,12 @@ int writeImage( const std::string& filename, Image *image )
             return -1;
         }
         
-        Image *flip= (new Image())->create(image->width, image->height, 3, Image::FLOAT);
-        for(int y= 0; y < image->height; y++)
-        for(int x= 0; x < image->width; x++)
-            flip->setPixel(x, image->height - y -1, image->pixel(x, y));
+        Image flip;
+        flip.create(image->width, image->height, 3, Image::FLOAT);
+        copyImage(&flip, image, true);
         
-        int code= RGBE_WritePixels_RLE(out, (const float *) flip->data, image->width, image->height);
+        int code= RGBE_WritePixels_RLE(out, (const float *) flip.data, image->width, image->height);
         fclose(out);
-        delete flip;
         if(code != RGBE_RETURN_SUCCESS)
         {
             ERROR("writing hdr image '%s'... failed.\n", filename.c_str());
@@ -0,0 +1,134 @@
+
+#include <cstdlib>
+#include <cassert>
+#include <map>
+
+#include "ImagePool.h"
+
+
+namespace gk {
+
+namespace ImagePool {
+
+//! entete d'un bloc, place juste avant les donnees alignees.
+struct header
+{
+    void *block;        //!< adresse renvoyee par malloc().
+    size_t length;      //!< taille utile du bloc.
+};
+
+//! blocs libres, indexes par taille.
+struct pool
+{
+    std::multimap<size_t, unsigned char *> blocks;
+    size_t bytes;
+    size_t limit;
+
+    pool( ) : blocks(), bytes(0), limit(size_t(256) << 20) {}
+};
+
+//! pool global, jamais detruit : des images peuvent etre detruites apres les variables statiques.
+static
+pool& instance( )
+{
+    static pool *p= new pool();
+    return *p;
+}
+
+static
+header *block_header( unsigned char *data )
+{
+    return (header *) data -1;
+}
+
+static
+void destroy( unsigned char *data )
+{
+    free(block_header(data)->block);
+}
+
+//! detruit les blocs les plus gros jusqu'a respecter la limite.
+static
+void trim( pool& p )
+{
+    while(p.bytes > p.limit && p.blocks.empty() == false)
+    {
+        std::multimap<size_t, unsigned char *>::iterator last= p.blocks.end();
+        --last;
+        p.bytes-= last->first;
+        destroy(last->second);
+        p.blocks.erase(last);
+    }
+}
+
+
+unsigned char *allocate( const size_t length )
+{
+    unsigned char *data= NULL;
+    #pragma omp critical(image_pool)
+    {
+        pool& p= instance();
+        std::multimap<size_t, unsigned char *>::iterator found= p.blocks.find(length);
+        if(found != p.blocks.end())
+        {
+            data= found->second;
+            p.bytes-= length;
+            p.blocks.erase(found);
+        }
+    }
+    if(data != NULL)
+        return data;
+
+    // aligne les donnees, en reservant la place de l'entete
+    void *block= malloc(length + sizeof(header) + ALIGNMENT);
+    if(block == NULL)
+        return NULL;
+
+    const size_t address= ((size_t) block + sizeof(header) + ALIGNMENT -1) & ~(size_t) (ALIGNMENT -1);
+    data= (unsigned char *) address;
+    block_header(data)->block= block;
+    block_header(data)->length= length;
+    return data;
+}
+
+void release( unsigned char *data )
+{
+    if(data == NULL)
+        return;
+    assert(((size_t) data & (ALIGNMENT -1)) == 0);
+
+    #pragma omp critical(image_pool)
+    {
+        pool& p= instance();
+        const size_t length= block_header(data)->length;
+        p.blocks.insert( std::make_pair(length, data) );
+        p.bytes+= length;
+        trim(p);
+    }
+}
+
+void clear( )
+{
+    #pragma omp critical(image_pool)
+    {
+        pool& p= instance();
+        for(std::multimap<size_t, unsigned char *>::iterator i= p.blocks.begin(); i != p.blocks.end(); ++i)
+            destroy(i->second);
+        p.blocks.clear();
+        p.bytes= 0;
+    }
+}
+
+void setLimit( const size_t bytes )
+{
+    #pragma omp critical(image_pool)
+    {
+        pool& p= instance();
+        p.limit= bytes;
+        trim(p);
+    }
+}
+
+}       // namespace
+
+}       // namespace
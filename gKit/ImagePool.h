@@ -0,0 +1,32 @@
+
+#ifndef _IMAGE_POOL_H
+#define _IMAGE_POOL_H
+
+#include <cstddef>
+
+
+namespace gk {
+
+//! allocation des pixels des images : blocs alignes, recycles par taille, pour eviter de solliciter l'allocateur a chaque image temporaire.
+namespace ImagePool {
+
+//! alignement des blocs, en octets, une ligne de cache.
+enum { ALIGNMENT= 64 };
+
+//! alloue un bloc de length octets, aligne sur ALIGNMENT octets. reutilise un bloc libere de meme taille, si possible.
+unsigned char *allocate( const size_t length );
+
+//! rend un bloc alloue par allocate() au pool. le bloc est conserve tant que le pool ne depasse pas sa limite, cf setLimit().
+void release( unsigned char *data );
+
+//! detruit tous les blocs conserves par le pool.
+void clear( );
+
+//! fixe la quantite maximale de memoire, en octets, conservee par le pool. 0 desactive le recyclage.
+void setLimit( const size_t bytes );
+
+}       // namespace
+
+}       // namespace
+
+#endif
@@ -0,0 +1,202 @@
+
+#ifndef _IMAGE_VIEW_H
+#define _IMAGE_VIEW_H
+
+#include <cassert>
+#include <algorithm>
+
+#include "Image.h"
+
+
+namespace gk {
+
+//! type des composantes d'une image, cf Image::type.
+template< typename T > struct ImageType;
+template< > struct ImageType<unsigned char> { typedef unsigned char value_type; enum { type= Image::UNSIGNED_BYTE }; };
+template< > struct ImageType<const unsigned char> { typedef unsigned char value_type; enum { type= Image::UNSIGNED_BYTE }; };
+template< > struct ImageType<float> { typedef float value_type; enum { type= Image::FLOAT }; };
+template< > struct ImageType<const float> { typedef float value_type; enum { type= Image::FLOAT }; };
+
+/*! acces type aux pixels d'une image : T type des composantes, unsigned char ou float, const eventuellement, N nombre de composantes par pixel.
+ le type et le nombre de composantes sont verifies une seule fois, a la construction, les boucles sur les pixels utilisent directement les pointeurs
+ renvoyes par row() ou operator()( ), sans conversion.
+
+ \code
+    gk::ImageView<float, 4> pixels(image);
+    if(pixels.valid())
+        for(int y= 0; y < pixels.height; y++)
+        {
+            float *p= pixels.row(y);
+            for(int x= 0; x < pixels.width; x++, p+= 4)
+                p[0]= 1.f;      // rouge
+        }
+ \endcode
+ */
+template< typename T, int N >
+struct ImageView
+{
+    T *data;            //!< premier pixel, NULL si la vue n'est pas valide.
+    int width;
+    int height;
+    int depth;
+    int stride;         //!< nombre de composantes par ligne.
+    int slice;          //!< nombre de composantes par plan.
+
+    //! constructeur par defaut, vue invalide.
+    ImageView( ) : data(NULL), width(0), height(0), depth(0), stride(0), slice(0) {}
+
+    //! construit une vue sur les pixels de image. la vue n'est pas valide si le type ou le nombre de composantes de l'image sont differents, cf valid().
+    explicit ImageView( const Image *image ) : data(NULL), width(0), height(0), depth(0), stride(0), slice(0)
+    {
+        if(image == NULL || image->data == NULL || image->type != (unsigned int) ImageType<T>::type || image->channels != N)
+            return;
+
+        data= (T *) image->data;
+        width= image->width;
+        height= image->height;
+        depth= std::max(image->depth, 1);
+        stride= width * N;
+        slice= height * stride;
+    }
+
+    //! renvoie vrai si la vue correspond au type et au nombre de composantes de l'image.
+    bool valid( ) const { return data != NULL; }
+
+    //! renvoie le premier pixel de la ligne y.
+    T *row( const int y, const int z= 0 ) const
+    {
+        assert(y >= 0 && y < height);
+        assert(z >= 0 && z < depth);
+        return data + z * slice + y * stride;
+    }
+
+    //! renvoie les composantes du pixel (x, y).
+    T *operator() ( const int x, const int y ) const
+    {
+        assert(x >= 0 && x < width);
+        return row(y) + x * N;
+    }
+
+    //! renvoie les composantes du pixel (x, y, z).
+    T *operator() ( const int x, const int y, const int z ) const
+    {
+        assert(x >= 0 && x < width);
+        return row(y, z) + x * N;
+    }
+};
+
+
+//! conversion d'une composante : [0 1] pour les reels, [0 255] pour les octets.
+template< typename D, typename S > inline D channel_cast( const S v );
+template< > inline float channel_cast<float, float>( const float v ) { return v; }
+template< > inline unsigned char channel_cast<unsigned char, unsigned char>( const unsigned char v ) { return v; }
+template< > inline float channel_cast<float, unsigned char>( const unsigned char v ) { return (float) v / 255.f; }
+template< > inline unsigned char channel_cast<unsigned char, float>( const float v ) { return (unsigned char) (std::min(std::max(v, 0.f), 1.f) * 255.f + .5f); }
+
+//! valeur par defaut d'une composante absente : 0, ou 1 pour alpha.
+template< typename D > inline D channel_default( const int c );
+template< > inline float channel_default<float>( const int c ) { return (c == 3) ? 1.f : 0.f; }
+template< > inline unsigned char channel_default<unsigned char>( const int c ) { return (c == 3) ? 255 : 0; }
+
+/*! copie les pixels de src dans dst, avec conversion du type et du nombre de composantes, cf Image::pixel().
+ si flip est vrai, les lignes sont inversees. les 2 vues doivent avoir les memes dimensions.
+ */
+template< typename D, int ND, typename S, int NS >
+void copy( const ImageView<D, ND>& dst, const ImageView<S, NS>& src, const bool flip= false )
+{
+    assert(dst.width == src.width && dst.height == src.height && dst.depth == src.depth);
+    const int n= std::min(ND, NS);
+    for(int z= 0; z < src.depth; z++)
+    for(int y= 0; y < src.height; y++)
+    {
+        const S *s= src.row(flip ? src.height - y -1 : y, z);
+        D *d= dst.row(y, z);
+        for(int x= 0; x < src.width; x++, s+= NS, d+= ND)
+        {
+            for(int c= 0; c < n; c++)
+                d[c]= channel_cast<typename ImageType<D>::value_type, typename ImageType<S>::value_type>(s[c]);
+            for(int c= n; c < ND; c++)
+                d[c]= channel_default<D>(c);
+        }
+    }
+}
+
+//! selectionne la vue sur src, cf copyImage().
+template< typename D, int ND >
+bool copy_from( const ImageView<D, ND>& dst, const Image *src, const bool flip )
+{
+    if(src->type == Image::UNSIGNED_BYTE)
+        switch(src->channels)
+        {
+            case 1: copy(dst, ImageView<const unsigned char, 1>(src), flip); return true;
+            case 2: copy(dst, ImageView<const unsigned char, 2>(src), flip); return true;
+            case 3: copy(dst, ImageView<const unsigned char, 3>(src), flip); return true;
+            case 4: copy(dst, ImageView<const unsigned char, 4>(src), flip); return true;
+        }
+    else if(src->type == Image::FLOAT)
+        switch(src->channels)
+        {
+            case 1: copy(dst, ImageView<const float, 1>(src), flip); return true;
+            case 2: copy(dst, ImageView<const float, 2>(src), flip); return true;
+            case 3: copy(dst, ImageView<const float, 3>(src), flip); return true;
+            case 4: copy(dst, ImageView<const float, 4>(src), flip); return true;
+        }
+
+    return false;
+}
+
+//! copie les pixels de src dans dst, avec conversion du type et du nombre de composantes. si flip est vrai, les lignes sont inversees.
+//! les 2 images doivent avoir les memes dimensions. renvoie -1 en cas d'erreur.
+inline
+int copyImage( Image *dst, const Image *src, const bool flip= false )
+{
+    if(dst == NULL || src == NULL || dst->data == NULL || src->data == NULL)
+        return -1;
+    if(dst->width != src->width || dst->height != src->height || dst->depth != src->depth)
+        return -1;
+
+    bool code= false;
+    if(dst->type == Image::UNSIGNED_BYTE)
+        switch(dst->channels)
+        {
+            case 1: code= copy_from(ImageView<unsigned char, 1>(dst), src, flip); break;
+            case 2: code= copy_from(ImageView<unsigned char, 2>(dst), src, flip); break;
+            case 3: code= copy_from(ImageView<unsigned char, 3>(dst), src, flip); break;
+            case 4: code= copy_from(ImageView<unsigned char, 4>(dst), src, flip); break;
+        }
+    else if(dst->type == Image::FLOAT)
+        switch(dst->channels)
+        {
+            case 1: code= copy_from(ImageView<float, 1>(dst), src, flip); break;
+            case 2: code= copy_from(ImageView<float, 2>(dst), src, flip); break;
+            case 3: code= copy_from(ImageView<float, 3>(dst), src, flip); break;
+            case 4: code= copy_from(ImageView<float, 4>(dst), src, flip); break;
+        }
+
+    return code ? 0 : -1;
+}
+
+//! retourne l'image, sur place : echange les lignes y et height -1 -y de chaque plan.
+inline
+void flipImage( Image *image )
+{
+    if(image == NULL || image->data == NULL)
+        return;
+
+    const size_t length= (size_t) image->width * image->channels * image->pixel_sizeof;
+    const int depth= std::max(image->depth, 1);
+    for(int z= 0; z < depth; z++)
+    {
+        unsigned char *plane= image->data + (size_t) z * image->height * length;
+        for(int y= 0; y < image->height / 2; y++)
+        {
+            unsigned char *a= plane + (size_t) y * length;
+            unsigned char *b= plane + (size_t) (image->height - y -1) * length;
+            std::swap_ranges(a, a + length, b);
+        }
+    }
+}
+
+}       // namespace
+
+#endif
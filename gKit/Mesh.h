@@ -32,7 +32,7 @@ struct MeshMaterial
         name("default"),
         diffuse_texture(), specular_texture(),
         diffuse_color(0.8f, 0.8f, 0.8f), specular_color(0.0f, 0.0f, 0.0f), emission(0.0f, 0.0f, 0.0f, 0.0f),
-        kd(1.0f), ks(0.0f)
+        kd(1.0f), ks(0.0f), ns(0.0f), ni(1.0f)
     {}
     
     //! construction d'une matiere nommee.
@@ -41,7 +41,7 @@ struct MeshMaterial
         name(_name),
         diffuse_texture(), specular_texture(),
         diffuse_color(), specular_color(), emission(),
-        kd(0.0f), ks(0.0f)
+        kd(0.0f), ks(0.0f), ns(0.0f), ni(1.0f)
     {}
 };
 
@@ -0,0 +1,187 @@
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#include "MeshAdjacency.h"
+#include "Mesh.h"
+
+
+namespace gk {
+
+/*! ensemble des aretes : table de hachage, adressage ouvert, sondage lineaire.
+    chaque case stocke une arete, sommets tries, et les coins opposes des 2 triangles qui la partagent.
+ */
+struct edge_table
+{
+    struct edge
+    {
+        unsigned int a, b;      //!< sommets de l'arete, a < b.
+        int corners[2];         //!< coins opposes aux aretes orientees a -> b et b -> a, -1 si absente, -2 si l'arete n'est pas manifold. case libre si les 2 sont absentes.
+    };
+
+    std::vector<edge> slots;
+    unsigned int mask;
+
+    //! prepare la table pour count aretes au plus, remplie au plus a moitie.
+    edge_table( const unsigned int count ) : slots(), mask(0)
+    {
+        size_t n= 64;
+        while(n < 2 * (size_t) count)
+            n= n * 2;
+
+        edge empty= { 0u, 0u, { -1, -1 } };
+        slots.assign(n, empty);
+        mask= n -1;
+    }
+
+    static unsigned int hash( const unsigned int a, const unsigned int b )
+    {
+        unsigned int h= a * 0x9E3779B1u;
+        h= (h ^ (h >> 15)) + b * 0x85EBCA77u;
+        h= (h ^ (h >> 13)) * 0xC2B2AE3Du;
+        return h ^ (h >> 16);
+    }
+
+    //! renvoie la case de l'arete a b, l'insere si necessaire.
+    edge& insert( const unsigned int emin, const unsigned int emax )
+    {
+        for(unsigned int h= hash(emin, emax) & mask; ; h= (h +1) & mask)
+        {
+            edge& e= slots[h];
+            if(e.corners[0] == -1 && e.corners[1] == -1)
+            {
+                e.a= emin;
+                e.b= emax;
+                return e;
+            }
+            
+            if(e.a == emin && e.b == emax)
+                return e;
+        }
+    }
+};
+
+
+int MeshAdjacency::build( const Mesh *_mesh )
+{
+    mesh= _mesh;
+    opposites.clear();
+    corners.clear();
+    if(mesh == NULL)
+        return -1;
+
+    const std::vector<unsigned int>& indices= mesh->indices;
+    const int count= (indices.size() / 3u) * 3u;
+    const unsigned int vertex_count= mesh->positions.size();
+    for(int i= 0; i < count; i++)
+        if(indices[i] >= vertex_count)
+        {
+            printf("MeshAdjacency::build( ): invalid index %u, %u vertices.\n", indices[i], vertex_count);
+            mesh= NULL;
+            return -1;
+        }
+
+    // le coin oppose a c est de l'autre cote de l'arete orientee dans l'autre sens
+    opposites.assign(count, -1);
+    edge_table edges(count);            // au plus une arete par coin, maillage non soude ou aretes vives
+    for(int c= 0; c < count; c++)
+    {
+        const unsigned int a= indices[next(c)];
+        const unsigned int b= indices[prev(c)];
+        edge_table::edge& e= edges.insert(std::min(a, b), std::max(a, b));
+        if(e.corners[0] == -2)
+            continue;
+        
+        const int side= (a < b) ? 0 : 1;
+        if(e.corners[side] != -1)
+        {
+            // l'arete orientee est deja presente : plus de 2 triangles ou orientation incoherente
+            if(e.corners[0] >= 0) opposites[e.corners[0]]= -1;
+            if(e.corners[1] >= 0) opposites[e.corners[1]]= -1;
+            e.corners[0]= -2;
+            e.corners[1]= -2;
+            continue;
+        }
+        
+        e.corners[side]= c;
+        const int o= e.corners[1 - side];
+        if(o >= 0)
+        {
+            opposites[c]= o;
+            opposites[o]= c;
+        }
+    }
+
+    // un coin par sommet, le premier coin d'un eventail ouvert pour les sommets de bord
+    corners.assign(vertex_count, -1);
+    for(int c= 0; c < count; c++)
+    {
+        const unsigned int v= indices[c];
+        if(corners[v] < 0 || opposites[next(c)] < 0)
+            corners[v]= c;
+    }
+
+    return 0;
+}
+
+bool MeshAdjacency::valid( ) const
+{
+    return (mesh != NULL && opposites.size() == (mesh->indices.size() / 3u) * 3u && corners.size() == mesh->positions.size());
+}
+
+unsigned int MeshAdjacency::vertex( const int c ) const
+{
+    return mesh->indices[c];
+}
+
+void MeshAdjacency::triangleNeighbours( const int t, int neighbours[3] ) const
+{
+    for(int k= 0; k < 3; k++)
+    {
+        const int o= opposites[3*t + k];
+        neighbours[k]= (o < 0) ? -1 : triangle(o);
+    }
+}
+
+int MeshAdjacency::vertexTriangles( const unsigned int v, std::vector<int>& triangles ) const
+{
+    triangles.clear();
+    const int start= corners[v];
+    if(start < 0)
+        return 0;
+
+    int c= start;
+    do
+    {
+        triangles.push_back(triangle(c));
+        c= swing(c);
+    }
+    while(c >= 0 && c != start);
+
+    return (int) triangles.size();
+}
+
+int MeshAdjacency::vertexNeighbours( const unsigned int v, std::vector<unsigned int>& neighbours ) const
+{
+    neighbours.clear();
+    const int start= corners[v];
+    if(start < 0)
+        return 0;
+
+    // eventail ouvert, le premier voisin est sur le bord
+    if(opposites[next(start)] < 0)
+        neighbours.push_back(vertex(prev(start)));
+
+    int c= start;
+    do
+    {
+        neighbours.push_back(vertex(next(c)));
+        c= swing(c);
+    }
+    while(c >= 0 && c != start);
+
+    return (int) neighbours.size();
+}
+
+}       // namespace
@@ -0,0 +1,68 @@
+
+#ifndef _MESH_ADJACENCY_H
+#define _MESH_ADJACENCY_H
+
+#include <cstddef>
+#include <vector>
+
+
+namespace gk {
+
+struct Mesh;
+
+/*! adjacence des triangles d'un mesh, representation "corner table" : un coin par sommet de triangle, le coin c du triangle c/3 correspond a mesh->indices[c].
+    le coin oppose a c est le coin du triangle voisin, de l'autre cote de l'arete (vertex(next(c)), vertex(prev(c))).
+
+    construction en temps lineaire, cf build(), a refaire si les indices du mesh sont modifies.
+    les aretes non manifold, partagees par plus de 2 triangles ou orientees de maniere incoherente, sont traitees comme des bords.
+ */
+struct MeshAdjacency
+{
+    const Mesh *mesh;                   //!< mesh decrit par l'adjacence.
+    std::vector<int> opposites;         //!< coin oppose de chaque coin, -1 sur un bord.
+    std::vector<int> corners;           //!< un coin de chaque sommet, le premier coin sur le bord pour les sommets de bord, -1 pour un sommet inutilise.
+
+    MeshAdjacency( ) : mesh(NULL), opposites(), corners() {}
+
+    //! construit l'adjacence des triangles de mesh. renvoie -1 en cas d'erreur.
+    int build( const Mesh *mesh );
+
+    //! renvoie vrai si l'adjacence correspond toujours aux indices du mesh.
+    bool valid( ) const;
+
+    //! renvoie le triangle du coin c.
+    static int triangle( const int c ) { return c / 3; }
+    //! renvoie le coin suivant dans le triangle.
+    static int next( const int c ) { return (c % 3 == 2) ? c - 2 : c + 1; }
+    //! renvoie le coin precedent dans le triangle.
+    static int prev( const int c ) { return (c % 3 == 0) ? c + 2 : c - 1; }
+
+    //! renvoie le sommet du coin c.
+    unsigned int vertex( const int c ) const;
+    //! renvoie le coin oppose a c, ou -1 si l'arete opposee a c est sur un bord.
+    int opposite( const int c ) const { return opposites[c]; }
+    //! renvoie un coin du sommet v, ou -1.
+    int corner( const unsigned int v ) const { return corners[v]; }
+    //! renvoie vrai si l'arete opposee au coin c est sur un bord.
+    bool boundary( const int c ) const { return opposites[c] < 0; }
+
+    //! renvoie le coin suivant autour du sommet de c, dans le triangle voisin de l'arete (vertex(c), vertex(next(c))), ou -1 sur un bord.
+    int swing( const int c ) const
+    {
+        const int o= opposites[prev(c)];
+        return (o < 0) ? -1 : prev(o);
+    }
+
+    //! renvoie les 3 triangles voisins du triangle t, -1 sur un bord. le voisin k est de l'autre cote de l'arete opposee au sommet k.
+    void triangleNeighbours( const int t, int neighbours[3] ) const;
+
+    //! renvoie les triangles adjacents au sommet v, dans l'ordre. renvoie le nombre de triangles.
+    //! si plusieurs eventails de triangles partagent le sommet (sommet non manifold), seul l'eventail de corner(v) est parcouru.
+    int vertexTriangles( const unsigned int v, std::vector<int>& triangles ) const;
+    //! renvoie les sommets voisins du sommet v, dans l'ordre. renvoie le nombre de voisins.
+    int vertexNeighbours( const unsigned int v, std::vector<unsigned int>& neighbours ) const;
+};
+
+}       // namespace
+
+#endif
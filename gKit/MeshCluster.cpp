@@ -0,0 +1,301 @@
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "MeshCluster.h"
+#include "MeshAdjacency.h"
+#include "Mesh.h"
+#include "Transform.h"
+
+
+namespace gk {
+
+namespace MeshClusters {
+
+//! intervalle de triangles d'un groupe de faces.
+struct range
+{
+    unsigned int begin;
+    unsigned int end;
+    int group;
+
+    range( const unsigned int _begin, const unsigned int _end, const int _group ) : begin(_begin), end(_end), group(_group) {}
+};
+
+//! calcule les englobants et le cone des normales d'un cluster.
+static
+void bounds( const Mesh *mesh, MeshCluster& cluster )
+{
+    cluster.bbox.clear();
+    for(unsigned int i= cluster.begin; i < cluster.end; i++)
+        cluster.bbox.Union(Point(mesh->positions[mesh->indices[i]]));
+
+    const Point& pmin= cluster.bbox.pMin;
+    const Point& pmax= cluster.bbox.pMax;
+    cluster.center= Point((pmin.x + pmax.x) / 2, (pmin.y + pmax.y) / 2, (pmin.z + pmax.z) / 2);
+
+    float radius= 0.f;
+    float x= 0.f, y= 0.f, z= 0.f;
+    for(unsigned int i= cluster.begin; i < cluster.end; i+= 3)
+    {
+        const Vec3& a= mesh->positions[mesh->indices[i]];
+        const Vec3& b= mesh->positions[mesh->indices[i +1]];
+        const Vec3& c= mesh->positions[mesh->indices[i +2]];
+        for(int k= 0; k < 3; k++)
+        {
+            const Vec3& p= (k == 0) ? a : (k == 1) ? b : c;
+            const float dx= p.x - cluster.center.x, dy= p.y - cluster.center.y, dz= p.z - cluster.center.z;
+            radius= std::max(radius, dx*dx + dy*dy + dz*dz);
+        }
+
+        // normale ponderee par l'aire du triangle
+        const float abx= b.x - a.x, aby= b.y - a.y, abz= b.z - a.z;
+        const float acx= c.x - a.x, acy= c.y - a.y, acz= c.z - a.z;
+        x+= aby * acz - abz * acy;
+        y+= abz * acx - abx * acz;
+        z+= abx * acy - aby * acx;
+    }
+    cluster.radius= sqrtf(radius);
+
+    // cone des normales : axe moyen, et ecart maximal a l'axe
+    cluster.cone_cos= -1.f;
+    cluster.cone_sin= 0.f;
+    const float length= sqrtf(x*x + y*y + z*z);
+    if(length == 0.f)
+        return;
+
+    cluster.cone_axis= Vector(x / length, y / length, z / length);
+    float cos_min= 1.f;
+    for(unsigned int i= cluster.begin; i < cluster.end; i+= 3)
+    {
+        const Vec3& a= mesh->positions[mesh->indices[i]];
+        const Vec3& b= mesh->positions[mesh->indices[i +1]];
+        const Vec3& c= mesh->positions[mesh->indices[i +2]];
+        const float abx= b.x - a.x, aby= b.y - a.y, abz= b.z - a.z;
+        const float acx= c.x - a.x, acy= c.y - a.y, acz= c.z - a.z;
+        const float nx= aby * acz - abz * acy;
+        const float ny= abz * acx - abx * acz;
+        const float nz= abx * acy - aby * acx;
+        const float n= sqrtf(nx*nx + ny*ny + nz*nz);
+        if(n == 0.f)
+            continue;   // triangle degenere, jamais dessine
+
+        cos_min= std::min(cos_min, (nx * cluster.cone_axis.x + ny * cluster.cone_axis.y + nz * cluster.cone_axis.z) / n);
+    }
+
+    // demi angle superieur a 90 degres, le cluster n'est jamais entierement oriente vers l'arriere
+    if(cos_min <= 0.f)
+        return;
+
+    cluster.cone_cos= cos_min;
+    cluster.cone_sin= sqrtf(std::max(0.f, 1.f - cos_min * cos_min));
+}
+
+int build( Mesh *mesh, std::vector<MeshCluster>& clusters, const unsigned int max_triangles, const unsigned int max_vertices )
+{
+    clusters.clear();
+    if(mesh == NULL || max_triangles == 0 || max_vertices < 3)
+        return -1;
+
+    MeshAdjacency adjacency;
+    if(adjacency.build(mesh) < 0)
+        return -1;
+
+    const unsigned int triangle_count= mesh->indices.size() / 3u;
+    const unsigned int vertex_count= mesh->positions.size();
+
+    // groupes de faces, les triangles hors groupe forment un dernier intervalle
+    std::vector<range> ranges;
+    std::vector<unsigned char> grouped(triangle_count, 0);
+    for(unsigned int g= 0; g < mesh->groups.size(); g++)
+    {
+        const unsigned int begin= std::min(mesh->groups[g].begin / 3u, triangle_count);
+        const unsigned int end= std::min(mesh->groups[g].end / 3u, triangle_count);
+        ranges.push_back( range(begin, end, g) );
+        for(unsigned int i= begin; i < end; i++)
+            grouped[i]= 1;
+    }
+    if(std::find(grouped.begin(), grouped.end(), 0) != grouped.end())
+        ranges.push_back( range(0, triangle_count, -1) );
+
+    // fait grossir chaque cluster a partir d'un triangle, par voisinages successifs
+    std::vector<unsigned char> assigned(triangle_count, 0);
+    std::vector<int> stamps(vertex_count, -1);
+    std::vector<unsigned int> order;
+    order.reserve(triangle_count);
+    std::vector<int> queue;
+    std::vector<unsigned int> group_begin(mesh->groups.size(), 0);
+    std::vector<unsigned int> group_end(mesh->groups.size(), 0);
+    for(unsigned int r= 0; r < ranges.size(); r++)
+    {
+        const unsigned int begin= ranges[r].begin;
+        const unsigned int end= ranges[r].end;
+        const int group= ranges[r].group;
+        if(group >= 0)
+            group_begin[group]= 3u * order.size();
+
+        for(unsigned int seed= begin; seed < end; seed++)
+        {
+            if(assigned[seed] || (group < 0 && grouped[seed]))
+                continue;
+
+            const int id= (int) clusters.size();
+            clusters.push_back( MeshCluster() );
+            clusters.back().begin= 3u * order.size();
+            clusters.back().group= group;
+
+            unsigned int triangles= 0;
+            unsigned int vertices= 0;
+            queue.clear();
+            queue.push_back(seed);
+            unsigned int next= seed +1;
+            for(unsigned int head= 0; triangles < max_triangles; head++)
+            {
+                if(head == queue.size())
+                {
+                    // plus de voisins : continue avec le prochain triangle libre du groupe, proche dans l'ordre des indices
+                    if(vertices + 3 > max_vertices)
+                        break;
+                    while(next < end && (assigned[next] || (group < 0 && grouped[next])))
+                        next++;
+                    if(next == end)
+                        break;
+                    queue.push_back(next++);
+                }
+                
+                const int t= queue[head];
+                if(assigned[t])
+                    continue;
+
+                const unsigned int *v= &mesh->indices[3 * t];
+                unsigned int count= 0;
+                for(int k= 0; k < 3; k++)
+                    if(stamps[v[k]] != id && (k == 0 || v[k] != v[0]) && (k < 2 || v[k] != v[1]))
+                        count++;
+                if(vertices + count > max_vertices)
+                    continue;   // sera repris par un autre cluster
+
+                assigned[t]= 1;
+                order.push_back(t);
+                triangles++;
+                vertices+= count;
+                for(int k= 0; k < 3; k++)
+                    stamps[v[k]]= id;
+
+                int neighbours[3];
+                adjacency.triangleNeighbours(t, neighbours);
+                for(int k= 0; k < 3; k++)
+                {
+                    const int n= neighbours[k];
+                    if(n >= (int) begin && n < (int) end && !assigned[n] && (group >= 0 || !grouped[n]))
+                        queue.push_back(n);
+                }
+            }
+
+            clusters.back().end= 3u * order.size();
+        }
+
+        if(group >= 0)
+            group_end[group]= 3u * order.size();
+    }
+
+    // reordonne les triangles
+    std::vector<unsigned int> indices(3u * triangle_count);
+    for(unsigned int i= 0; i < triangle_count; i++)
+        for(int k= 0; k < 3; k++)
+            indices[3*i + k]= mesh->indices[3*order[i] + k];
+    mesh->indices.swap(indices);
+
+    if(mesh->materials.size() == triangle_count)
+    {
+        std::vector<int> materials(triangle_count);
+        for(unsigned int i= 0; i < triangle_count; i++)
+            materials[i]= mesh->materials[order[i]];
+        mesh->materials.swap(materials);
+    }
+
+    for(unsigned int g= 0; g < mesh->groups.size(); g++)
+    {
+        mesh->groups[g].begin= group_begin[g];
+        mesh->groups[g].end= group_end[g];
+    }
+
+    #pragma omp parallel for schedule(dynamic, 64)
+    for(int i= 0; i < (int) clusters.size(); i++)
+        bounds(mesh, clusters[i]);
+
+    return (int) clusters.size();
+}
+
+
+bool camera( const Transform& mvp, Point& position )
+{
+    // la camera se projette sur le point a l'infini (0, 0, 1, 0)
+    const Matrix4x4& m= mvp.inverseMatrix();
+    const float w= m.m[3][2];
+    if(fabsf(w) < 1e-8f)
+        return false;
+
+    position= Point(m.m[0][2] / w, m.m[1][2] / w, m.m[2][2] / w);
+    return true;
+}
+
+bool visible( const MeshCluster& cluster, const Transform& mvp, const Point& eye, const bool backface )
+{
+    // frustum : rejette le cluster si les 8 sommets de l'englobant sont du meme cote d'un des plans
+    unsigned int outside= 0x3F;
+    for(int i= 0; i < 8 && outside != 0; i++)
+    {
+        const Point p((i & 1) ? cluster.bbox.pMax.x : cluster.bbox.pMin.x,
+            (i & 2) ? cluster.bbox.pMax.y : cluster.bbox.pMin.y,
+            (i & 4) ? cluster.bbox.pMax.z : cluster.bbox.pMin.z);
+        HPoint h;
+        mvp(p, h);
+
+        unsigned int planes= 0;
+        if(h.x < -h.w) planes|= 1;
+        if(h.x > h.w) planes|= 2;
+        if(h.y < -h.w) planes|= 4;
+        if(h.y > h.w) planes|= 8;
+        if(h.z < -h.w) planes|= 16;
+        if(h.z > h.w) planes|= 32;
+        outside&= planes;
+    }
+    if(outside != 0)
+        return false;
+
+    if(!backface || cluster.cone_cos <= 0.f)
+        return true;
+
+    // cone : tous les triangles sont orientes vers l'arriere si dot(n, p - eye) > 0 pour toutes les normales du cone et tous les points de la sphere
+    const float vx= cluster.center.x - eye.x, vy= cluster.center.y - eye.y, vz= cluster.center.z - eye.z;
+    const float length= sqrtf(vx*vx + vy*vy + vz*vz);
+    if(length <= cluster.radius)
+        return true;
+
+    const float cos_theta= (vx * cluster.cone_axis.x + vy * cluster.cone_axis.y + vz * cluster.cone_axis.z) / length;
+    const float sin_theta= sqrtf(std::max(0.f, 1.f - cos_theta * cos_theta));
+    if(cos_theta > 0.f && length * (cos_theta * cluster.cone_cos - sin_theta * cluster.cone_sin) >= cluster.radius)
+        return false;
+
+    return true;
+}
+
+int cull( const std::vector<MeshCluster>& clusters, const Transform& mvp, std::vector<unsigned int>& visible_clusters )
+{
+    visible_clusters.clear();
+
+    Point eye;
+    const bool backface= camera(mvp, eye);
+    for(unsigned int i= 0; i < clusters.size(); i++)
+        if(visible(clusters[i], mvp, eye, backface))
+            visible_clusters.push_back(i);
+
+    return (int) visible_clusters.size();
+}
+
+}       // namespace
+
+}       // namespace
@@ -0,0 +1,56 @@
+
+#ifndef _MESH_CLUSTER_H
+#define _MESH_CLUSTER_H
+
+#include <vector>
+
+#include "Geometry.h"
+
+
+namespace gk {
+
+struct Mesh;
+class Transform;
+
+//! groupe de triangles voisins (meshlet), cf MeshClusters::build().
+struct MeshCluster
+{
+    unsigned int begin;         //!< premier indice du cluster dans Mesh::indices.
+    unsigned int end;           //!< dernier indice + 1.
+    int group;                  //!< groupe de faces / matiere du cluster, cf Mesh::groups.
+
+    BBox bbox;                  //!< englobant des sommets.
+    Point center;               //!< sphere englobante.
+    float radius;
+
+    Vector cone_axis;           //!< cone des normales des triangles : axe et demi angle d'ouverture.
+    float cone_cos;             //!< cosinus du demi angle, -1 si les normales ne sont pas bornees.
+    float cone_sin;             //!< sinus du demi angle.
+
+    MeshCluster( ) : begin(0), end(0), group(-1), bbox(), center(), radius(0.f), cone_axis(), cone_cos(-1.f), cone_sin(0.f) {}
+};
+
+//! decoupage d'un mesh en clusters de triangles voisins, et elimination des clusters non visibles.
+namespace MeshClusters {
+
+/*! decoupe le mesh en clusters d'au plus max_triangles triangles et max_vertices sommets.
+ les triangles sont reordonnes pour que chaque cluster soit un intervalle de Mesh::indices, les clusters ne melangent pas les groupes de faces.
+ modifie indices, materials et groups. renvoie le nombre de clusters, ou -1 en cas d'erreur.
+ */
+int build( Mesh *mesh, std::vector<MeshCluster>& clusters, const unsigned int max_triangles= 128, const unsigned int max_vertices= 128 );
+
+//! renvoie la position de la camera dans le repere objet, pour une projection perspective. mvp : transformation du repere objet vers le repere projectif.
+//! renvoie false pour une projection orthographique.
+bool camera( const Transform& mvp, Point& position );
+
+//! renvoie vrai si le cluster est visible : au moins en partie dans le frustum, et pas entierement oriente vers l'arriere, vu depuis eye (repere objet).
+bool visible( const MeshCluster& cluster, const Transform& mvp, const Point& eye, const bool backface= true );
+
+//! elimine les clusters non visibles, renvoie dans visible_clusters les indices des clusters a dessiner. renvoie le nombre de clusters visibles.
+int cull( const std::vector<MeshCluster>& clusters, const Transform& mvp, std::vector<unsigned int>& visible_clusters );
+
+}       // namespace
+
+}       // namespace
+
+#endif
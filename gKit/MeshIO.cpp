@@ -1,7 +1,14 @@
 
 #include <cstdio>
+#include <cstring>
+#include <cmath>
 #include <vector> 
-#include <map> 
+#include <algorithm> 
+
+#ifndef WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+#endif
 
 #include "IOFileSystem.h"
 
@@ -25,17 +32,111 @@ struct index
     index( ) : position(-1), texcoord(-1), normal(-1), material(-1) {}
     index( const int _p, const int _t, const int _n, const int _mat ) : position(_p), texcoord(_t), normal(_n), material(_mat) {}
     
-    bool operator< ( const index& b ) const
+    bool operator== ( const index& b ) const
+    {
+        return (position == b.position && texcoord == b.texcoord && normal == b.normal && material == b.material);
+    }
+};
+
+/*! ensemble des sommets uniques : table de hachage, adressage ouvert, sondage lineaire.
+ les sommets sont numerotes dans l'ordre d'insertion.
+ */
+struct index_table
+{
+    std::vector<int> slots;     //!< indice du sommet dans keys, ou -1 si la case est libre.
+    std::vector<index> keys;    //!< sommets uniques.
+    unsigned int mask;
+    
+    //! constructeur, hint : estimation du nombre de sommets uniques.
+    index_table( const unsigned int hint ) : slots(), keys(), mask(0)
+    {
+        unsigned int n= 64;
+        while(n < 2 * hint)
+            n= n * 2;
+        
+        slots.assign(n, -1);
+        mask= n -1;
+        keys.reserve(hint);
+    }
+    
+    static unsigned int hash( const index& key )
+    {
+        unsigned int h= (unsigned int) key.position * 0x9E3779B1u;
+        h= (h ^ (h >> 15)) + (unsigned int) key.texcoord * 0x85EBCA77u;
+        h= (h ^ (h >> 13)) + (unsigned int) key.normal * 0xC2B2AE3Du;
+        h= (h ^ (h >> 16)) + (unsigned int) key.material * 0x27D4EB2Fu;
+        return h ^ (h >> 15);
+    }
+    
+    //! renvoie l'indice du sommet, l'insere si necessaire.
+    int insert( const index& key )
     {
-        if(material != b.material)
-            return (material < b.material);
+        // agrandit la table, au plus 1/2 remplie
+        if(2 * (keys.size() +1) > slots.size())
+            grow();
         
-        // ordre lexicographique pour comparer le triplet d'indices
-        if(position != b.position)
-            return (position < b.position);
-        if(texcoord != b.texcoord)
-            return (texcoord < b.texcoord);
-        return (normal < b.normal);
+        for(unsigned int h= hash(key) & mask; ; h= (h +1) & mask)
+        {
+            const int id= slots[h];
+            if(id < 0)
+            {
+                slots[h]= (int) keys.size();
+                keys.push_back(key);
+                return slots[h];
+            }
+            
+            if(keys[id] == key)
+                return id;
+        }
+    }
+    
+    void grow( )
+    {
+        slots.assign(2 * slots.size(), -1);
+        mask= slots.size() -1;
+        for(unsigned int i= 0; i < keys.size(); i++)
+        {
+            unsigned int h= hash(keys[i]) & mask;
+            while(slots[h] >= 0)
+                h= (h +1) & mask;
+            slots[h]= i;
+        }
+    }
+    
+    unsigned int size( ) const { return keys.size(); }
+};
+
+//! directive mtllib ou usemtl, a appliquer aux sommets suivants.
+struct directive
+{
+    unsigned int offset;        //!< premier sommet concerne, cf chunk::indices.
+    bool library;               //!< mtllib ou usemtl.
+    std::string name;
+    
+    directive( const unsigned int _offset, const bool _library, const std::string& _name ) : offset(_offset), library(_library), name(_name) {}
+};
+
+//! resultat de l'analyse d'une partie du fichier, independante des autres parties.
+struct chunk
+{
+    std::vector<Vec3> positions;
+    std::vector<Vec3> texcoords;
+    std::vector<Vec3> normals;
+    std::vector<index> indices;                 //!< sommets des triangles, indices a partir de 0, absolus ou relatifs au debut de la partie.
+    std::vector<unsigned char> relative;        //!< bits 0, 1, 2 : les indices de position, texcoord, normale de chaque sommet sont relatifs.
+    std::vector<directive> directives;          //!< mtllib et usemtl, dans l'ordre du fichier.
+    const char *error;                          //!< premiere ligne mal formee, ou NULL.
+    
+    chunk( ) : positions(), texcoords(), normals(), indices(), relative(), directives(), error(NULL) {}
+    
+    //! libere la memoire.
+    void release( )
+    {
+        std::vector<Vec3>().swap(positions);
+        std::vector<Vec3>().swap(texcoords);
+        std::vector<Vec3>().swap(normals);
+        std::vector<index>().swap(indices);
+        std::vector<unsigned char>().swap(relative);
     }
 };
 
@@ -44,177 +145,484 @@ struct index
 
 namespace MeshIO {
 
+//! verifie un indice d'attribut, renvoie -1 s'il est invalide.
 static 
-int attribute( const int index, const int count )
+int attribute( const int a, const int count )
 {
-    int a;
-    if(index < 0)
-        a= index + count;       // indexation relative aux derniers sommets
-    else
-        a= index - 1;           // indexations classique
-    
     if(a < 0 || a >= count)
-        printf("invalid index %d, max %d\n", index, count);
+    {
+        printf("invalid index %d, max %d\n", a +1, count);
+        return -1;
+    }
+    
     return a;
 }
 
 
-//! analyse un fichier .obj et construit un objet Mesh.
-Mesh *readOBJ( const std::string& filename ) 
+//! charge le contenu complet d'un fichier, termine par un 0.
+static
+int read_text( const std::string& filename, std::vector<char>& text )
 {
-    // ouvre le fichier
-    FILE *in= fopen(filename.c_str(), "rt");
+    FILE *in= fopen(filename.c_str(), "rb");
     if(in == NULL)
+        return -1;
+    
+    long int size= -1;
+    if(fseek(in, 0, SEEK_END) == 0)
+        size= ftell(in);
+    rewind(in);
+    if(size < 0)
     {
-        printf("error reading '%s'.\n", filename.c_str());
-        return NULL;
+        fclose(in);
+        return -1;
     }
     
-    printf("loading '%s'...\n", filename.c_str());
+    // 1 seule lecture, pas de lecture ligne par ligne
+    text.resize(size +1);
+    size_t n= fread(&text.front(), 1, size, in);
+    fclose(in);
     
-    // cree le mesh
-    Mesh *mesh= new Mesh;
+    text[n]= 0;
+    return (n == (size_t) size) ? 0 : -1;
+}
+
+// analyse lexicale, independante de la locale.
+
+//! saute les espaces, sans changer de ligne.
+static
+const char *skip_blanks( const char *s )
+{
+    while(*s == ' ' || *s == '\t' || *s == '\r')
+        s++;
+    return s;
+}
+
+//! renvoie le debut de la ligne suivante.
+static
+const char *next_line( const char *s )
+{
+    while(*s != 0 && *s != '\n')
+        s++;
+    if(*s == '\n')
+        s++;
+    return s;
+}
+
+//! renvoie vrai si s commence par le mot-cle key, suivi d'un espace.
+static
+bool keyword( const char *s, const char *key )
+{
+    while(*key != 0)
+        if(*s++ != *key++)
+            return false;
     
-    // indexation des attributs de sommets
-    std::vector<Vec3> positions;
-    std::vector<Vec3> texcoords;
-    std::vector<Vec3> normals;
-    std::vector<OBJ::index> indices;
-    std::vector<MeshMaterial> materials;
-    int material_id= -1;
-    int material_base= 0;
+    return (*s == ' ' || *s == '\t');
+}
+
+//! recupere la fin de la ligne, sans les espaces, les noms de fichiers peuvent contenir des espaces.
+static
+std::string line_end( const char *s )
+{
+    s= skip_blanks(s);
+    const char *e= s;
+    while(*e != 0 && *e != '\n' && *e != '\r')
+        e++;
+    while(e > s && (e[-1] == ' ' || e[-1] == '\t'))
+        e--;
     
-    //~ bool has_normal= true;
-    //~ bool has_texcoord= true;
-    bool has_material= true;
+    return std::string(s, e);
+}
+
+//! lit un entier. renvoie la position du caractere suivant, ou NULL en cas d'erreur.
+static
+const char *parse_int( const char *s, int& v )
+{
+    bool negative= false;
+    if(*s == '-' || *s == '+')
+        negative= (*s++ == '-');
+    if(*s < '0' || *s > '9')
+        return NULL;
     
-    char line[1024];
-    char tmp[1024];
-    bool error= true;
-    for(;;)
+    int n= 0;
+    for(; *s >= '0' && *s <= '9'; s++)
+        n= n * 10 + (*s - '0');
+    
+    v= negative ? -n : n;
+    return s;
+}
+
+//! lit un reel, [+-]chiffres[.chiffres][(e|E)[+-]chiffres]. renvoie la position du caractere suivant, ou NULL en cas d'erreur.
+static
+const char *parse_float( const char *s, float& v )
+{
+    static const double powers[23]= 
     {
-        // charge une ligne du fichier
-        if(fgets(line, sizeof(line), in) == NULL)
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    
+    s= skip_blanks(s);
+    bool negative= false;
+    if(*s == '-' || *s == '+')
+        negative= (*s++ == '-');
+    
+    // mantisse, 18 chiffres significatifs au maximum, suffisant pour un float
+    unsigned long long mantissa= 0;
+    int digits= 0;
+    int exponent= 0;
+    bool valid= false;
+    for(; *s >= '0' && *s <= '9'; s++, valid= true)
+    {
+        if(digits < 18)
         {
-            error= false;               // fin du fichier, pas d'erreur detectee
-            break;
+            mantissa= mantissa * 10 + (*s - '0');
+            if(mantissa != 0)
+                digits++;
         }
+        else
+            exponent++;
+    }
+    
+    if(*s == '.')
+    {
+        for(s++; *s >= '0' && *s <= '9'; s++, valid= true)
+        {
+            if(digits < 18)
+            {
+                mantissa= mantissa * 10 + (*s - '0');
+                if(mantissa != 0)
+                    digits++;
+                exponent--;
+            }
+        }
+    }
+    
+    if(valid == false)
+        return NULL;
+    
+    if(*s == 'e' || *s == 'E')
+    {
+        int e;
+        const char *next= parse_int(s +1, e);
+        if(next != NULL)
+        {
+            exponent+= e;
+            s= next;
+        }
+    }
+    
+    double d= (double) mantissa;
+    if(mantissa != 0)
+    {
+        for(; exponent < -22; exponent+= 22)
+            d/= powers[22];
+        for(; exponent > 22; exponent-= 22)
+            d*= powers[22];
         
-        line[sizeof(line) -1]= 0;       // force la fin de la ligne
-        if(line[0] == 'v')
+        if(exponent < 0)
+            d/= powers[-exponent];
+        else
+            d*= powers[exponent];
+    }
+    
+    v= (float) (negative ? -d : d);
+    return s;
+}
+
+//! lit n reels, renvoie le nombre de reels lus.
+static
+int parse_floats( const char *s, float *v, const int n )
+{
+    for(int i= 0; i < n; i++)
+    {
+        s= parse_float(s, v[i]);
+        if(s == NULL)
+            return i;
+    }
+    
+    return n;
+}
+
+
+//! convertit un indice obj : 1 pour le premier attribut, -1 pour le dernier attribut lu. 
+//! renvoie un indice a partir de 0, relatif au debut de la partie si l'indice obj est negatif.
+static
+int local_index( const int index, const int count, unsigned char& relative, const unsigned char bit )
+{
+    if(index < 0)
+    {
+        relative|= bit;
+        return index + count;   // indexation relative aux derniers sommets
+    }
+    
+    return index - 1;           // indexation classique
+}
+
+//! analyse les lignes [begin end) d'un fichier .obj. begin et end sont des debuts de lignes.
+static
+void parse_chunk( const char *begin, const char *end, OBJ::chunk& chunk )
+{
+    for(const char *line= begin; line < end; line= next_line(line))
+    {
+        const char *s= skip_blanks(line);
+        if(s[0] == 'v')
         {
-            if(line[1] == ' ')          // position
+            float v[3];
+            if(s[1] == ' ' || s[1] == '\t')     // position
             {
-                float x, y, z;
-                if(sscanf(line, "v %f %f %f", &x, &y, &z) != 3)
-                    break;
-                positions.push_back( Vec3(x, y, z) );
+                if(parse_floats(s +2, v, 3) != 3)
+                {
+                    chunk.error= line;
+                    return;
+                }
+                chunk.positions.push_back( Vec3(v[0], v[1], v[2]) );
             }
-            else if(line[1] == 'n')     // normal
+            else if(s[1] == 'n')        // normal
             {
-                float x, y, z;
-                if(sscanf(line, "vn %f %f %f", &x, &y, &z) != 3)
-                    break;
-                normals.push_back( Vec3(x, y, z) );
+                if(parse_floats(s +2, v, 3) != 3)
+                {
+                    chunk.error= line;
+                    return;
+                }
+                chunk.normals.push_back( Vec3(v[0], v[1], v[2]) );
             }
-            else if(line[1] == 't')     // texcoord
+            else if(s[1] == 't')        // texcoord
             {
-                float u, v, w;
-                int status= sscanf(line, "vt %f %f %f", &u, &v, &w);
+                int status= parse_floats(s +2, v, 3);
                 if(status == 2)
-                    w= 0.f;             // vt u v, pas de composante w
-                if(status >= 2)
-                    texcoords.push_back( Vec3(u, v, w) );
-                else
-                    break;
+                    v[2]= 0.f;          // vt u v, pas de composante w
+                if(status < 2)
+                {
+                    chunk.error= line;
+                    return;
+                }
+                chunk.texcoords.push_back( Vec3(v[0], v[1], v[2]) );
             }
         }
         
-        else if(line[0] == 'm')
+        else if(s[0] == 'm')
         {
             // charger un ensemble de matieres
-            if(sscanf(line, "mtllib %[^\r\n]", tmp) == 1)       // lit toute la ligne, recupere les noms de fichiers avec des espaces.
-            {
-                material_base= materials.size();
-                readMTL(IOFileSystem::pathname(filename) + tmp, materials);
-            }
+            if(keyword(s, "mtllib"))
+                chunk.directives.push_back( OBJ::directive(chunk.indices.size(), true, line_end(s + 6)) );
         }
         
-        else if(line[0] == 'u')
+        else if(s[0] == 'u')
         {
-            if(sscanf(line, "usemtl %[^\r\n]", tmp) == 1) // lit toute la ligne, recupere les noms de fichiers avec des espaces.
-            {
-                // ajouter les faces suivantes au groupe associe a la matiere
-                material_id= -1;
-                for(unsigned int i= material_base; i < materials.size(); i++)
-                    if(materials[i].name == tmp)
-                    {
-                        material_id= i;
-                        break;
-                    }
-            }
+            // ajouter les faces suivantes au groupe associe a la matiere
+            if(keyword(s, "usemtl"))
+                chunk.directives.push_back( OBJ::directive(chunk.indices.size(), false, line_end(s + 6)) );
         }
         
-        else if(line[0] == 'f')         // triangle/quad
+        else if(s[0] == 'f')            // polygone convexe
         {
-            OBJ::index face[4];
-            int ia, ita, ina;
-            int n;
-            
+            OBJ::index first;
+            OBJ::index previous;
+            unsigned char first_relative= 0;
+            unsigned char previous_relative= 0;
             int count= 0;
-            char *next= line +1;
-            for(;;)
+            for(s= skip_blanks(s +1); *s != 0 && *s != '\n' && *s != '#'; s= skip_blanks(s))
             {
-                if(sscanf(next, " %d/%d/%d %n", &ia, &ita, &ina, &n) == 3)      // v/t/n format
-                    face[count]= OBJ::index(attribute(ia, positions.size()), attribute(ita, texcoords.size()), attribute(ina, normals.size()), material_id);
-                
-                else if(sscanf(next, " %d//%d %n", &ia, &ina, &n) == 2)         // v//n format
-                    face[count]= OBJ::index(attribute(ia, positions.size()), -1, attribute(ina, normals.size()), material_id);
-                
-                else if(sscanf(next, " %d/%d %n", &ia, &ita, &n) == 2)          // v/t  format
-                    face[count]= OBJ::index(attribute(ia, positions.size()), attribute(ita, texcoords.size()), -1, material_id);
-                
-                else if(sscanf(next, " %d %n", &ia, &n) == 1)                   // v format
-                    face[count]= OBJ::index(attribute(ia, positions.size()), -1, -1, material_id);
+                // formats v, v/t, v//n, v/t/n
+                int ia, ita, ina;
+                bool t= false;
+                bool n= false;
+                s= parse_int(s, ia);
+                if(s != NULL && *s == '/')
+                {
+                    s++;
+                    if(*s != '/')
+                    {
+                        s= parse_int(s, ita);
+                        t= true;
+                    }
+                    if(s != NULL && *s == '/')
+                    {
+                        s= parse_int(s +1, ina);
+                        n= true;
+                    }
+                }
                 
-                else
-                    break;
+                if(s == NULL)
+                {
+                    // sommet mal forme, pas de face partielle
+                    chunk.error= line;
+                    return;
+                }
                 
-                // verifie la coherence du modele
-                //~ if(face[count].material == -1)
-                if(material_id < 0)
-                    has_material= false;
-                //~ if(face[count].normal == -1)
-                    //~ has_normal= false;
-                //~ if(face[count].texcoord == -1)
-                    //~ has_texcoord= false;
+                // les indices negatifs sont relatifs aux attributs deja lus par cette partie, corriges par readOBJ()
+                unsigned char relative= 0;
+                OBJ::index corner(local_index(ia, chunk.positions.size(), relative, 1), 
+                    t ? local_index(ita, chunk.texcoords.size(), relative, 2) : -1, 
+                    n ? local_index(ina, chunk.normals.size(), relative, 4) : -1, 
+                    -1);
                 
-                count++;
-                if(count >= 3)
+                // triangule le polygone
+                if(count == 0)
+                {
+                    first= corner;
+                    first_relative= relative;
+                }
+                if(count >= 2)
                 {
-                    // triangule les polygones convexes de plus 3 sommets
-                    indices.push_back(face[0]);
-                    indices.push_back(face[count -2]);
-                    indices.push_back(face[count -1]);
+                    chunk.indices.push_back(first);
+                    chunk.indices.push_back(previous);
+                    chunk.indices.push_back(corner);
+                    chunk.relative.push_back(first_relative);
+                    chunk.relative.push_back(previous_relative);
+                    chunk.relative.push_back(relative);
                 }
                 
-                next= next +n;
-                if(n == 0 || count >= 4)
-                    break;
+                previous= corner;
+                previous_relative= relative;
+                count++;
             }
         }
     }
-    
-    fclose(in);
-    if(error)
+}
+
+
+/*! analyse un fichier .obj et construit un objet Mesh.
+ le fichier est decoupe en parties de 1Mo, analysees en parallele. les parties sont ensuite assemblees dans l'ordre du fichier,
+ le resultat ne depend pas du nombre de threads.
+ si libraries n'est pas NULL, renvoie les noms des fichiers .mtl references par mtllib, relatifs au repertoire du fichier .obj.
+ */
+static
+Mesh *parseOBJ( const std::string& filename, std::vector<std::string> *libraries= NULL ) 
+{
+    // charge le fichier complet
+    std::vector<char> text;
+    if(read_text(filename, text) < 0)
     {
-        printf("loading mesh '%s'... failed.\n  %lu/%lu/%lu triangles, parsing line:\n%s\n", 
-            filename.c_str(), positions.size(), texcoords.size(), normals.size(),
-            line);
-        delete mesh;
+        printf("error reading '%s'.\n", filename.c_str());
         return NULL;
     }
     
+    printf("loading '%s'...\n", filename.c_str());
+    
+    // decoupe le fichier en parties, sur des debuts de lignes
+    const char *data= &text.front();
+    const size_t size= text.size() -1;
+    std::vector<const char *> starts(1, data);
+    for(size_t offset= 1u << 20; offset < size; offset+= 1u << 20)
+    {
+        const char *s= next_line(std::max(data + offset -1, starts.back()));
+        if(s < data + size && s > starts.back())
+            starts.push_back(s);
+    }
+    starts.push_back(data + size);
+    
+    // analyse les parties en parallele
+    const int n= (int) starts.size() -1;
+    std::vector<OBJ::chunk> chunks(n);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int i= 0; i < n; i++)
+        parse_chunk(starts[i], starts[i +1], chunks[i]);
+    
+    for(int i= 0; i < n; i++)
+        if(chunks[i].error != NULL)
+        {
+            const char *line= chunks[i].error;
+            const int number= (int) std::count(data, line, '\n') +1;
+            printf("loading mesh '%s'... failed, parsing line %d:\n%.*s\n", filename.c_str(), number, (int) (next_line(line) - line), line);
+            return NULL;
+        }
+    
+    // position des attributs et des sommets de chaque partie dans le mesh
+    std::vector<unsigned int> position_base(n +1, 0);
+    std::vector<unsigned int> texcoord_base(n +1, 0);
+    std::vector<unsigned int> normal_base(n +1, 0);
+    std::vector<unsigned int> index_base(n +1, 0);
+    for(int i= 0; i < n; i++)
+    {
+        position_base[i +1]= position_base[i] + chunks[i].positions.size();
+        texcoord_base[i +1]= texcoord_base[i] + chunks[i].texcoords.size();
+        normal_base[i +1]= normal_base[i] + chunks[i].normals.size();
+        index_base[i +1]= index_base[i] + chunks[i].indices.size();
+    }
+    
+    // charge les matieres et identifie la matiere active au debut de chaque partie, dans l'ordre du fichier
+    std::vector<MeshMaterial> materials;
+    std::vector< std::vector<int> > chunk_materials(n);        // matiere associee a chaque directive
+    std::vector<int> material_start(n, -1);
+    int material_id= -1;
+    int material_base= 0;
+    for(int i= 0; i < n; i++)
+    {
+        material_start[i]= material_id;
+        for(unsigned int d= 0; d < chunks[i].directives.size(); d++)
+        {
+            const OBJ::directive& directive= chunks[i].directives[d];
+            if(directive.library)
+            {
+                material_base= materials.size();
+                readMTL(IOFileSystem::pathname(filename) + directive.name, materials);
+                if(libraries != NULL)
+                    libraries->push_back(directive.name);
+            }
+            else
+            {
+                material_id= -1;
+                for(unsigned int m= material_base; m < materials.size(); m++)
+                    if(materials[m].name == directive.name)
+                    {
+                        material_id= m;
+                        break;
+                    }
+            }
+            
+            chunk_materials[i].push_back(material_id);
+        }
+    }
+    
+    // assemble les parties, en parallele
+    std::vector<Vec3> positions(position_base[n]);
+    std::vector<Vec3> texcoords(texcoord_base[n]);
+    std::vector<Vec3> normals(normal_base[n]);
+    std::vector<OBJ::index> indices(index_base[n]);
+    
+    std::vector<int> defaults(n, 0);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for(int i= 0; i < n; i++)
+    {
+        OBJ::chunk& chunk= chunks[i];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + position_base[i]);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), texcoords.begin() + texcoord_base[i]);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + normal_base[i]);
+        
+        int material= material_start[i];
+        unsigned int d= 0;
+        for(unsigned int k= 0; k < chunk.indices.size(); k++)
+        {
+            for(; d < chunk.directives.size() && chunk.directives[d].offset <= k; d++)
+                material= chunk_materials[i][d];
+            
+            // termine l'indexation relative aux derniers attributs
+            OBJ::index corner= chunk.indices[k];
+            const unsigned char relative= chunk.relative[k];
+            corner.position= attribute(corner.position + ((relative & 1) ? position_base[i] : 0), positions.size());
+            if(corner.texcoord != -1 || (relative & 2))
+                corner.texcoord= attribute(corner.texcoord + ((relative & 2) ? texcoord_base[i] : 0), texcoords.size());
+            if(corner.normal != -1 || (relative & 4))
+                corner.normal= attribute(corner.normal + ((relative & 4) ? normal_base[i] : 0), normals.size());
+            
+            // verifie la coherence du modele
+            corner.material= material;
+            if(material < 0)
+                defaults[i]= 1;
+            
+            indices[index_base[i] + k]= corner;
+        }
+        
+        // libere la memoire de la partie
+        chunk.release();
+    }
+    
+    bool has_material= (std::find(defaults.begin(), defaults.end(), 1) == defaults.end());
+    
+    // cree le mesh
+    Mesh *mesh= new Mesh;
+    
     if(indices.empty())
     {
         // renvoie les donnes brutes, sans essayer de construire une indexation lineaire.
@@ -239,22 +647,20 @@ Mesh *readOBJ( const std::string& filename )
     
     // construit l'index buffer avec indexation unique
     // et re ordonne les attributs
-    std::map<OBJ::index, int> remap;
+    // estimation du nombre de sommets uniques : au moins 1 sommet par attribut
+    OBJ::index_table remap(std::max(positions.size(), std::max(texcoords.size(), normals.size())));
     mesh->indices.reserve(indices.size());
     
     // identifie les triplets uniques d'attributs pour construire une indexation "unique" / vertex buffer lineaire.
     material_id= -1;
     for(unsigned int i= 0; i < indices.size(); i++)
     {
-        std::pair< std::map<OBJ::index, int>::iterator, bool > found= 
-            remap.insert( std::make_pair(indices[i], remap.size()) );
-        mesh->indices.push_back(found.first->second);
+        mesh->indices.push_back(remap.insert(indices[i]));
         
-        // cree les groupes de faces utilisant la meme matiere
-        //! \todo fusionner les groupes de faces utilisant la meme matiere.
-        if(found.first->first.material != material_id)
+        // cree les groupes de faces utilisant la meme matiere, dans l'ordre du fichier, cf groupMaterials() pour les fusionner.
+        if(indices[i].material != material_id)
         {
-            material_id= found.first->first.material;
+            material_id= indices[i].material;
             mesh->groups.push_back( MeshGroup(materials[material_id], i) );
         }
         
@@ -282,24 +688,24 @@ Mesh *readOBJ( const std::string& filename )
     mesh->texcoords.resize(remap.size());
     mesh->normals.resize(remap.size());
     
-    // reordonne les attributs
-    for(unsigned int i= 0; i < indices.size(); i++)
+    // reordonne les attributs, 1 seule fois par sommet unique
+    for(unsigned int i= 0; i < remap.size(); i++)
     {
-        const int index= mesh->indices[i];
-        if(indices[i].position == -1)
+        const OBJ::index& index= remap.keys[i];
+        if(index.position == -1)
         {
             printf("loading mesh '%s'... failed.\n  invalid structure.\n", filename.c_str());
             delete mesh;
             return NULL;
         }
         
-        mesh->positions[index]= positions[indices[i].position];
+        mesh->positions[i]= positions[index.position];
         
-        if(indices[i].texcoord != -1)
-            mesh->texcoords[index]= texcoords[indices[i].texcoord];
+        if(index.texcoord != -1)
+            mesh->texcoords[i]= texcoords[index.texcoord];
             
-        if(indices[i].normal != -1)
-            mesh->normals[index]= normals[indices[i].normal];
+        if(index.normal != -1)
+            mesh->normals[i]= normals[index.normal];
     }
     
     printf("  %lu positions, %lu texcoords, %lu normals, %lu triangles\n",  
@@ -311,6 +717,385 @@ Mesh *readOBJ( const std::string& filename )
 }
 
 
+Mesh *readOBJ( const std::string& filename, const bool cache )
+{
+    // recharge la version binaire, si elle correspond au fichier .obj
+    IOInfo info;
+    const std::string binary= IOFileSystem::changeType(filename, ".gkmesh");
+    if(cache && IOFileSystem::infos(filename, info) == 0 && IOFileSystem::exists(binary) == 0)
+    {
+        Mesh *mesh= readGKMESH(binary, &info);
+        if(mesh != NULL)
+            return mesh;
+    }
+    
+    std::vector<std::string> libraries;
+    Mesh *mesh= parseOBJ(filename, &libraries);
+    if(cache && mesh != NULL && info.exists)
+        writeGKMESH(binary, mesh, info, libraries);        // pas grave en cas d'echec, le fichier .obj sera relu la prochaine fois
+    
+    return mesh;
+}
+
+
+// format binaire .gkmesh : en-tete, table des sections, sections alignees sur 64 octets.
+static const unsigned int GKMESH_MAGIC= 0x534D4B47u;   // 'G' 'K' 'M' 'S'
+static const unsigned int GKMESH_VERSION= 2;
+static const unsigned int GKMESH_ALIGN= 64;
+
+enum
+{
+    GKMESH_POSITIONS= 0,
+    GKMESH_TEXCOORDS,
+    GKMESH_NORMALS,
+    GKMESH_INDICES,
+    GKMESH_MATERIALS,
+    GKMESH_GROUPS,
+    GKMESH_STRINGS,
+    GKMESH_LIBRARIES,
+    GKMESH_SECTIONS
+};
+
+struct GKMESHSection
+{
+    unsigned long long offset;  //!< position des donnees dans le fichier.
+    unsigned long long length;  //!< longueur des donnees, en octets.
+};
+
+struct GKMESHHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned long long source_size;     //!< taille du fichier d'origine, cf IOInfo.
+    unsigned long long source_time;     //!< date du fichier d'origine, cf IOInfo.
+    GKMESHSection sections[GKMESH_SECTIONS];
+};
+
+//! groupe de faces et sa matiere, les chaines de caracteres sont stockees dans la section GKMESH_STRINGS.
+struct GKMESHGroup
+{
+    unsigned int begin;
+    unsigned int end;
+    unsigned int name;                  //!< position du nom dans la section GKMESH_STRINGS.
+    unsigned int diffuse_texture;
+    unsigned int specular_texture;
+    float diffuse_color[4];
+    float specular_color[4];
+    float emission[4];
+    float kd, ks, ns, ni;
+};
+
+//! fichier .mtl utilise par le fichier d'origine, les matieres du cache ne sont valides que s'il n'est pas modifie.
+struct GKMESHLibrary
+{
+    unsigned long long size;            //!< taille du fichier, cf IOInfo.
+    unsigned long long time;            //!< date du fichier, cf IOInfo.
+    unsigned int name;                  //!< position du nom dans la section GKMESH_STRINGS, relatif au repertoire du fichier .gkmesh.
+    unsigned int exists;                //!< 0 si le fichier n'existait pas.
+};
+
+//! ajoute une chaine terminee par 0, renvoie sa position.
+static
+unsigned int add_string( std::vector<char>& strings, const std::string& string )
+{
+    unsigned int offset= strings.size();
+    strings.insert(strings.end(), string.begin(), string.end());
+    strings.push_back(0);
+    return offset;
+}
+
+//! ecrit une section alignee.
+static
+int write_section( FILE *out, GKMESHSection& section, const void *data, const size_t length )
+{
+    static const char zeros[GKMESH_ALIGN]= { 0 };
+    long int offset= ftell(out);
+    if(offset < 0)
+        return -1;
+    
+    size_t padding= (GKMESH_ALIGN - offset % GKMESH_ALIGN) % GKMESH_ALIGN;
+    if(padding > 0 && fwrite(zeros, 1, padding, out) != padding)
+        return -1;
+    
+    section.offset= offset + padding;
+    section.length= length;
+    if(length > 0 && fwrite(data, 1, length, out) != length)
+        return -1;
+    return 0;
+}
+
+int writeGKMESH( const std::string& filename, const Mesh *mesh, const IOInfo& source, const std::vector<std::string>& libraries )
+{
+    if(mesh == NULL || sizeof(Vec3) != 3 * sizeof(float))
+        return -1;
+    
+    FILE *out= fopen(filename.c_str(), "wb");
+    if(out == NULL)
+    {
+        printf("error writing '%s'.\n", filename.c_str());
+        return -1;
+    }
+    
+    printf("writing '%s'...\n", filename.c_str());
+    
+    // groupes et matieres
+    std::vector<char> strings;
+    std::vector<GKMESHGroup> groups(mesh->groups.size());
+    for(unsigned int i= 0; i < mesh->groups.size(); i++)
+    {
+        const MeshGroup& group= mesh->groups[i];
+        GKMESHGroup& g= groups[i];
+        memset(&g, 0, sizeof(g));
+        g.begin= group.begin;
+        g.end= group.end;
+        g.name= add_string(strings, group.material.name);
+        g.diffuse_texture= add_string(strings, group.material.diffuse_texture);
+        g.specular_texture= add_string(strings, group.material.specular_texture);
+        for(int k= 0; k < 4; k++)
+        {
+            g.diffuse_color[k]= group.material.diffuse_color[k];
+            g.specular_color[k]= group.material.specular_color[k];
+            g.emission[k]= group.material.emission[k];
+        }
+        g.kd= group.material.kd;
+        g.ks= group.material.ks;
+        g.ns= group.material.ns;
+        g.ni= group.material.ni;
+    }
+    
+    // fichiers .mtl
+    std::vector<GKMESHLibrary> files(libraries.size());
+    for(unsigned int i= 0; i < libraries.size(); i++)
+    {
+        IOInfo info;
+        IOFileSystem::infos(IOFileSystem::pathname(filename) + libraries[i], info);
+        
+        GKMESHLibrary& f= files[i];
+        memset(&f, 0, sizeof(f));
+        f.size= info.size;
+        f.time= info.time;
+        f.name= add_string(strings, libraries[i]);
+        f.exists= info.exists ? 1 : 0;
+    }
+    
+    // en-tete provisoire, complete apres l'ecriture des sections
+    GKMESHHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic= GKMESH_MAGIC;
+    header.version= GKMESH_VERSION;
+    header.source_size= source.size;
+    header.source_time= source.time;
+    
+    bool error= (fwrite(&header, sizeof(header), 1, out) != 1);
+    if(error == false)
+        error= write_section(out, header.sections[GKMESH_POSITIONS], mesh->positions.empty() ? NULL : &mesh->positions.front(), mesh->positions.size() * sizeof(Vec3)) < 0
+        || write_section(out, header.sections[GKMESH_TEXCOORDS], mesh->texcoords.empty() ? NULL : &mesh->texcoords.front(), mesh->texcoords.size() * sizeof(Vec3)) < 0
+        || write_section(out, header.sections[GKMESH_NORMALS], mesh->normals.empty() ? NULL : &mesh->normals.front(), mesh->normals.size() * sizeof(Vec3)) < 0
+        || write_section(out, header.sections[GKMESH_INDICES], mesh->indices.empty() ? NULL : &mesh->indices.front(), mesh->indices.size() * sizeof(unsigned int)) < 0
+        || write_section(out, header.sections[GKMESH_MATERIALS], mesh->materials.empty() ? NULL : &mesh->materials.front(), mesh->materials.size() * sizeof(int)) < 0
+        || write_section(out, header.sections[GKMESH_GROUPS], groups.empty() ? NULL : &groups.front(), groups.size() * sizeof(GKMESHGroup)) < 0
+        || write_section(out, header.sections[GKMESH_LIBRARIES], files.empty() ? NULL : &files.front(), files.size() * sizeof(GKMESHLibrary)) < 0
+        || write_section(out, header.sections[GKMESH_STRINGS], strings.empty() ? NULL : &strings.front(), strings.size()) < 0;
+    
+    if(error == false)
+    {
+        rewind(out);
+        error= (fwrite(&header, sizeof(header), 1, out) != 1);
+    }
+    
+    fclose(out);
+    if(error)
+    {
+        printf("writing '%s'... failed.\n", filename.c_str());
+        remove(filename.c_str());
+        return -1;
+    }
+    
+    return 0;
+}
+
+
+//! copie une section dans un tableau.
+template < typename T >
+static
+bool read_section( const unsigned char *data, const size_t size, const GKMESHSection& section, std::vector<T>& v )
+{
+    if(section.offset > size || section.length > size - section.offset || section.length % sizeof(T) != 0)
+        return false;
+    
+    const T *begin= reinterpret_cast<const T *>(data + section.offset);
+    v.assign(begin, begin + section.length / sizeof(T));
+    return true;
+}
+
+//! verifie que les fichiers .mtl n'ont pas ete modifies depuis la creation du cache.
+static
+bool valid_libraries( const std::string& filename, const std::vector<GKMESHLibrary>& files, const std::vector<char>& strings )
+{
+    for(unsigned int i= 0; i < files.size(); i++)
+    {
+        if(files[i].name >= strings.size())
+            return false;
+        
+        IOInfo info;
+        IOFileSystem::infos(IOFileSystem::pathname(filename) + &strings[files[i].name], info);
+        if(info.exists != (files[i].exists != 0))
+            return false;
+        if(info.exists && (files[i].size != (unsigned long long) info.size || files[i].time != (unsigned long long) info.time))
+            return false;
+    }
+    
+    return true;
+}
+
+//! verifie la coherence du mesh : indices des sommets, matieres des triangles et groupes de faces.
+static
+bool valid_mesh( const Mesh *mesh )
+{
+    const size_t vertex_count= mesh->positions.size();
+    if(mesh->texcoords.empty() == false && mesh->texcoords.size() != vertex_count)
+        return false;
+    if(mesh->normals.empty() == false && mesh->normals.size() != vertex_count)
+        return false;
+    
+    if(mesh->indices.size() % 3 != 0)
+        return false;
+    for(unsigned int i= 0; i < mesh->indices.size(); i++)
+        if(mesh->indices[i] >= vertex_count)
+            return false;
+    
+    const size_t triangle_count= mesh->indices.size() / 3;
+    if(mesh->materials.empty() == false && mesh->materials.size() != triangle_count)
+        return false;
+    for(unsigned int i= 0; i < mesh->materials.size(); i++)
+        if(mesh->materials[i] < 0 || mesh->materials[i] >= (int) mesh->groups.size())
+            return false;
+    
+    for(unsigned int i= 0; i < mesh->groups.size(); i++)
+        if(mesh->groups[i].begin > mesh->groups[i].end || mesh->groups[i].end > mesh->indices.size())
+            return false;
+    
+    return true;
+}
+
+Mesh *readGKMESH( const std::string& filename, const IOInfo *source )
+{
+    if(sizeof(Vec3) != 3 * sizeof(float))
+        return NULL;
+    
+    // projette le fichier en memoire
+    const unsigned char *data= NULL;
+    size_t size= 0;
+#ifndef WIN32
+    int fd= open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        return NULL;
+    
+    struct stat info;
+    void *map= MAP_FAILED;
+    if(fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        size= info.st_size;
+        map= mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if(map == MAP_FAILED)
+        return NULL;
+    data= static_cast<const unsigned char *>(map);
+    
+#else
+    std::vector<unsigned char> buffer= IOFileSystem::readBinary(filename);
+    if(buffer.empty())
+        return NULL;
+    data= &buffer.front();
+    size= buffer.size();
+#endif
+    
+    Mesh *mesh= NULL;
+    GKMESHHeader header;
+    if(size >= sizeof(header))
+    {
+        memcpy(&header, data, sizeof(header));
+        
+        bool valid= (header.magic == GKMESH_MAGIC && header.version == GKMESH_VERSION);
+        if(valid && source != NULL)
+            valid= (header.source_size == (unsigned long long) source->size && header.source_time == (unsigned long long) source->time);
+        
+        if(valid)
+        {
+            printf("loading '%s'...\n", filename.c_str());
+            
+            mesh= new Mesh;
+            std::vector<GKMESHGroup> groups;
+            std::vector<GKMESHLibrary> files;
+            std::vector<char> strings;
+            valid= read_section(data, size, header.sections[GKMESH_POSITIONS], mesh->positions)
+                && read_section(data, size, header.sections[GKMESH_TEXCOORDS], mesh->texcoords)
+                && read_section(data, size, header.sections[GKMESH_NORMALS], mesh->normals)
+                && read_section(data, size, header.sections[GKMESH_INDICES], mesh->indices)
+                && read_section(data, size, header.sections[GKMESH_MATERIALS], mesh->materials)
+                && read_section(data, size, header.sections[GKMESH_GROUPS], groups)
+                && read_section(data, size, header.sections[GKMESH_LIBRARIES], files)
+                && read_section(data, size, header.sections[GKMESH_STRINGS], strings);
+            
+            if(valid && strings.empty() == false && strings.back() != 0)
+                valid= false;
+            
+            // les matieres ne sont plus valides si un fichier .mtl a ete modifie
+            if(valid && source != NULL)
+                valid= valid_libraries(filename, files, strings);
+            
+            for(unsigned int i= 0; valid && i < groups.size(); i++)
+            {
+                const GKMESHGroup& g= groups[i];
+                if(g.name >= strings.size() || g.diffuse_texture >= strings.size() || g.specular_texture >= strings.size())
+                {
+                    valid= false;
+                    break;
+                }
+                
+                MeshMaterial material(&strings[g.name]);
+                material.diffuse_texture= &strings[g.diffuse_texture];
+                material.specular_texture= &strings[g.specular_texture];
+                material.diffuse_color= VecColor(g.diffuse_color);
+                material.specular_color= VecColor(g.specular_color);
+                material.emission= VecColor(g.emission);
+                material.kd= g.kd;
+                material.ks= g.ks;
+                material.ns= g.ns;
+                material.ni= g.ni;
+                
+                mesh->groups.push_back( MeshGroup(material, g.begin) );
+                mesh->groups.back().end= g.end;
+            }
+            
+            // un fichier tronque ou modifie ne doit pas etre utilise
+            if(valid)
+                valid= valid_mesh(mesh);
+            
+            if(valid == false)
+            {
+                printf("loading '%s'... failed.\n", filename.c_str());
+                delete mesh;
+                mesh= NULL;
+            }
+            else
+            {
+                printf("  %lu positions, %lu texcoords, %lu normals, %lu triangles\n",  
+                    mesh->positions.size(), mesh->texcoords.size(), mesh->normals.size(), 
+                    mesh->indices.size() / 3);
+                printf("done.\n");
+            }
+        }
+    }
+    
+#ifndef WIN32
+    munmap(const_cast<unsigned char *>(data), size);
+#endif
+    return mesh;
+}
+
+
 //! analyse un fichier .mtl et construit un ensemble de description de matieres.
 int readMTL( const std::string& filename, std::vector<MeshMaterial>& materials )
 {
@@ -414,49 +1199,286 @@ int readMTL( const std::string& filename, std::vector<MeshMaterial>& materials )
 }
 
 
-//! calcule les normales moyenne par sommet.
-int buildNormals( Mesh *mesh )
+//! renvoie vrai si 2 groupes utilisent la meme matiere.
+static
+bool same_material( const MeshMaterial& a, const MeshMaterial& b )
+{
+    return (a.name == b.name 
+        && a.diffuse_texture == b.diffuse_texture && a.specular_texture == b.specular_texture
+        && a.diffuse_color == b.diffuse_color && a.specular_color == b.specular_color && a.emission == b.emission
+        && a.kd == b.kd && a.ks == b.ks);
+}
+
+int groupMaterials( Mesh *mesh )
 {
     if(mesh == NULL)
         return -1;
-
-    mesh->normals.assign(mesh->positions.size(), Vec3());
     
     const unsigned int triangles= mesh->indices.size() / 3u;
+    if(mesh->groups.empty() || mesh->materials.size() != triangles)
+        return -1;
+    
+    // verifie les matieres des triangles avant de les utiliser comme indices
     for(unsigned int i= 0; i < triangles; i++)
+        if(mesh->materials[i] < 0 || mesh->materials[i] >= (int) mesh->groups.size())
+            return -1;
+    
+    // identifie les groupes utilisant la meme matiere, dans l'ordre d'apparition
+    std::vector<int> remap(mesh->groups.size(), -1);
+    std::vector<MeshGroup> groups;
+    for(unsigned int i= 0; i < mesh->groups.size(); i++)
     {
-        const unsigned int ia= mesh->indices[3u*i];
-        const unsigned int ib= mesh->indices[3u*i +1u];
-        const unsigned int ic= mesh->indices[3u*i +2u];
+        for(unsigned int k= 0; k < groups.size(); k++)
+            if(same_material(groups[k].material, mesh->groups[i].material))
+            {
+                remap[i]= k;
+                break;
+            }
+        
+        if(remap[i] < 0)
+        {
+            remap[i]= groups.size();
+            groups.push_back( MeshGroup(mesh->groups[i].material, 0) );
+        }
+    }
+    
+    if(groups.size() == mesh->groups.size())
+    {
+        // pas de groupes a fusionner, verifie que les triangles sont tries
+        bool sorted= true;
+        for(unsigned int i= 1; i < triangles && sorted; i++)
+            if(remap[mesh->materials[i]] < remap[mesh->materials[i -1]])
+                sorted= false;
         
-        const Point a(mesh->positions[ia]);
-        const Point b(mesh->positions[ib]);
-        const Point c(mesh->positions[ic]);
+        if(sorted)
+            return 0;
+    }
+    
+    // compte les triangles de chaque matiere
+    std::vector<unsigned int> offsets(groups.size() +1, 0);
+    for(unsigned int i= 0; i < triangles; i++)
+        offsets[remap[mesh->materials[i]] +1]++;
+    
+    for(unsigned int k= 0; k < groups.size(); k++)
+    {
+        offsets[k +1]+= offsets[k];
+        groups[k].begin= 3u * offsets[k];
+        groups[k].end= 3u * offsets[k +1];
+    }
+    
+    // range les triangles par matiere, sans changer leur ordre dans chaque matiere
+    std::vector<unsigned int> indices(mesh->indices.size());
+    std::vector<int> materials(triangles);
+    for(unsigned int i= 0; i < triangles; i++)
+    {
+        const int g= remap[mesh->materials[i]];
+        const unsigned int t= offsets[g]++;
+        indices[3u*t]= mesh->indices[3u*i];
+        indices[3u*t +1u]= mesh->indices[3u*i +1u];
+        indices[3u*t +2u]= mesh->indices[3u*i +2u];
+        materials[t]= g;
+    }
+    
+    mesh->indices.swap(indices);
+    mesh->materials.swap(materials);
+    mesh->groups.swap(groups);
+    return 0;
+}
+
+
+//! normale d'un triangle, non normalisee : sa longueur est le double de l'aire du triangle.
+static
+Vec3 face_normal( const Vec3& a, const Vec3& b, const Vec3& c )
+{
+    const float abx= b.x - a.x, aby= b.y - a.y, abz= b.z - a.z;
+    const float acx= c.x - a.x, acy= c.y - a.y, acz= c.z - a.z;
+    return Vec3(aby * acz - abz * acy, abz * acx - abx * acz, abx * acy - aby * acx);
+}
+
+//! angle du triangle abc sur le sommet a.
+static
+float corner_angle( const Vec3& a, const Vec3& b, const Vec3& c )
+{
+    const float abx= b.x - a.x, aby= b.y - a.y, abz= b.z - a.z;
+    const float acx= c.x - a.x, acy= c.y - a.y, acz= c.z - a.z;
+    const float cx= aby * acz - abz * acy;
+    const float cy= abz * acx - abx * acz;
+    const float cz= abx * acy - aby * acx;
+    return atan2f(sqrtf(cx * cx + cy * cy + cz * cz), abx * acx + aby * acy + abz * acz);
+}
+
+static
+float dot( const Vec3& a, const Vec3& b )
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static
+Vec3 normalize( const Vec3& v )
+{
+    const float length= sqrtf(dot(v, v));
+    if(length == 0.f)
+        return Vec3(0.f, 0.f, 0.f);
+    return Vec3(v.x / length, v.y / length, v.z / length);
+}
+
+//! calcule les normales moyenne par sommet.
+int buildNormals( Mesh *mesh, const int weight, const float crease_angle )
+{
+    if(mesh == NULL)
+        return -1;
+    
+    const unsigned int vertex_count= mesh->positions.size();
+    const int triangles= mesh->indices.size() / 3u;
+    const int corners= triangles * 3;
+    for(int i= 0; i < corners; i++)
+        if(mesh->indices[i] >= vertex_count)
+        {
+            printf("buildNormals( ): invalid index %u, %u vertices.\n", mesh->indices[i], vertex_count);
+            return -1;
+        }
+    
+    // normales des faces, normalisees, et poids de chaque sommet de chaque triangle
+    std::vector<Vec3> faces(triangles);
+    std::vector<float> weights(corners);
+    #pragma omp parallel for schedule(static)
+    for(int i= 0; i < triangles; i++)
+    {
+        const Vec3& a= mesh->positions[mesh->indices[3*i]];
+        const Vec3& b= mesh->positions[mesh->indices[3*i +1]];
+        const Vec3& c= mesh->positions[mesh->indices[3*i +2]];
         
-        // attention aux triangles degeneres avec des aretes de longueur nulles
-        Vector ab(a, b);
-        //~ if(ab.Length() > 0.0f)
-            //~ ab= Normalize(ab);
+        // attention aux triangles degeneres : normale nulle, poids nul
+        const Vec3 n= face_normal(a, b, c);
+        const float area= sqrtf(dot(n, n));
+        faces[i]= normalize(n);
         
-        Vector ac(a, c);
-        //~ if(ac.Length() > 0.0f)
-            //~ ac= Normalize(ac);
+        if(weight == NORMAL_ANGLE)
+        {
+            weights[3*i]= corner_angle(a, b, c);
+            weights[3*i +1]= corner_angle(b, c, a);
+            weights[3*i +2]= corner_angle(c, a, b);
+        }
+        else
+        {
+            const float w= (weight == NORMAL_AREA) ? area : 1.f;
+            weights[3*i]= w;
+            weights[3*i +1]= w;
+            weights[3*i +2]= w;
+        }
+    }
+    
+    // adjacence sommet -> sommets des triangles, tri par denombrement
+    std::vector<unsigned int> offsets(vertex_count +1, 0);
+    for(int i= 0; i < corners; i++)
+        offsets[mesh->indices[i] +1]++;
+    for(unsigned int i= 0; i < vertex_count; i++)
+        offsets[i +1]+= offsets[i];
+    
+    std::vector<int> adjacency(corners);
+    {
+        std::vector<unsigned int> next(offsets.begin(), offsets.end() -1);
+        for(int i= 0; i < corners; i++)
+            adjacency[next[mesh->indices[i]]++]= i;
+    }
+    
+    if(crease_angle >= 180.f)
+    {
+        // normales lisses : chaque sommet accumule les normales de ses triangles
+        mesh->normals.resize(vertex_count);
+        #pragma omp parallel for schedule(static)
+        for(int v= 0; v < (int) vertex_count; v++)
+        {
+            float x= 0.f, y= 0.f, z= 0.f;
+            for(unsigned int k= offsets[v]; k < offsets[v +1]; k++)
+            {
+                const int c= adjacency[k];
+                const Vec3& n= faces[c / 3];
+                x+= weights[c] * n.x;
+                y+= weights[c] * n.y;
+                z+= weights[c] * n.z;
+            }
+            
+            mesh->normals[v]= normalize(Vec3(x, y, z));
+        }
         
-        //~ Vector bc(b, c);
-        //~ if(bc.Length() > 0.0f)
-            //~ bc= Normalize(bc);
+        return 0;
+    }
+    
+    // aretes vives : chaque sommet de triangle n'accumule que les normales proches de celle de son triangle,
+    // puis les sommets de triangles avec la meme normale partagent le meme sommet, les autres sont dupliques.
+    const float crease= cosf(std::max(crease_angle, 0.f) * float(M_PI) / 180.f);
+    std::vector<Vec3> normals(corners);
+    std::vector<int> clusters(corners);
+    std::vector<unsigned int> copies(vertex_count +1, 0);
+    #pragma omp parallel for schedule(static)
+    for(int v= 0; v < (int) vertex_count; v++)
+    {
+        int count= 0;
+        for(unsigned int k= offsets[v]; k < offsets[v +1]; k++)
+        {
+            const int c= adjacency[k];
+            const Vec3& face= faces[c / 3];
+            
+            float x= 0.f, y= 0.f, z= 0.f;
+            for(unsigned int j= offsets[v]; j < offsets[v +1]; j++)
+            {
+                const int o= adjacency[j];
+                const Vec3& n= faces[o / 3];
+                if(o != c && dot(face, n) < crease)
+                    continue;
+                
+                x+= weights[o] * n.x;
+                y+= weights[o] * n.y;
+                z+= weights[o] * n.z;
+            }
+            normals[c]= normalize(Vec3(x, y, z));
+            
+            // reutilise le sommet d'un triangle deja traite, s'il a la meme normale
+            clusters[c]= -1;
+            for(unsigned int j= offsets[v]; j < k; j++)
+            {
+                const int o= adjacency[j];
+                if(normals[o].x == normals[c].x && normals[o].y == normals[c].y && normals[o].z == normals[c].z)
+                {
+                    clusters[c]= clusters[o];
+                    break;
+                }
+            }
+            if(clusters[c] < 0)
+                clusters[c]= count++;
+        }
         
-        Vector n= Cross(ab, ac);
-        mesh->normals[ia]= Vector(mesh->normals[ia]) + n;
-        mesh->normals[ib]= Vector(mesh->normals[ib]) + n;
-        mesh->normals[ic]= Vector(mesh->normals[ic]) + n;
+        // le premier groupe conserve le sommet, les autres sont des copies
+        copies[v +1]= (count > 1) ? count -1 : 0;
     }
     
-    for(unsigned int i= 0; i < mesh->normals.size(); i++)
+    for(unsigned int i= 0; i < vertex_count; i++)
+        copies[i +1]+= copies[i];
+    
+    const unsigned int count= vertex_count + copies[vertex_count];
+    const bool texcoords= (mesh->texcoords.size() == vertex_count);
+    mesh->positions.resize(count);
+    if(texcoords)
+        mesh->texcoords.resize(count);
+    mesh->normals.resize(count);
+    
+    #pragma omp parallel for schedule(static)
+    for(int v= 0; v < (int) vertex_count; v++)
     {
-        Vector v(mesh->normals[i]);
-        //~ if(v.Length() > 0.0f)
-            mesh->normals[i]= Normalize(v);
+        for(unsigned int k= offsets[v]; k < offsets[v +1]; k++)
+        {
+            const int c= adjacency[k];
+            const unsigned int id= (clusters[c] == 0) ? v : vertex_count + copies[v] + clusters[c] -1;
+            mesh->indices[c]= id;
+            mesh->normals[id]= normals[c];
+            if(id != (unsigned int) v)
+            {
+                mesh->positions[id]= mesh->positions[v];
+                if(texcoords)
+                    mesh->texcoords[id]= mesh->texcoords[v];
+            }
+        }
     }
     
     return 0;
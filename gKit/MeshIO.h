@@ -3,6 +3,9 @@
 #define _MINI_OBJ_H
 
 #include <vector>
+#include <string>
+
+#include "IOFileSystem.h"
 
 
 namespace gk {
@@ -13,14 +16,43 @@ struct MeshMaterial;
 namespace MeshIO {
     
 //! charge un fichier .OBJ et construit un index buffer lineaire + les groupes de faces associes a chaque matiere.
+//! si cache est vrai, le mesh est enregistre au format .gkmesh, a cote du fichier .obj, et recharge directement tant que le fichier .obj n'est pas modifie, cf readGKMESH().
     //! \todo renvoyer Mesh::null() en cas d'echec
-Mesh *readOBJ( const std::string& filename );
+Mesh *readOBJ( const std::string& filename, const bool cache= true );
+
+/*! enregistre un mesh au format binaire .gkmesh : en-tete, table des sections, puis positions, texcoords, normals, indices, materials, 
+ groupes et matieres, alignes sur 64 octets. source : taille et date du fichier d'origine, cf IOFileSystem::infos().
+ libraries : fichiers .mtl utilises par le fichier d'origine, relatifs au repertoire de filename, leur taille et leur date sont aussi enregistrees.
+ */
+int writeGKMESH( const std::string& filename, const Mesh *mesh, const IOInfo& source= IOInfo(), 
+    const std::vector<std::string>& libraries= std::vector<std::string>() );
+
+//! charge un fichier .gkmesh, projete en memoire. renvoie NULL en cas d'erreur, si le mesh n'est pas coherent, 
+//! ou si source ne correspond pas au fichier d'origine utilise par writeGKMESH(), ou si un de ses fichiers .mtl a ete modifie.
+Mesh *readGKMESH( const std::string& filename, const IOInfo *source= NULL );
 
 //! charge un fichier .MTL et ajoute l'ensemble de matieres lues a materials.
 int readMTL( const std::string& filename, std::vector<MeshMaterial>& materials );
     
-//! recalcule les normales moyennes des sommets.
-int buildNormals( Mesh *mesh );
+/*! regroupe les triangles par matiere : 1 seul groupe par matiere, les triangles d'un groupe sont contigus. 
+ reordonne indices, reconstruit groups et materials. l'ordre des triangles utilisant la meme matiere est conserve.
+ renvoie -1 si une matiere de Mesh::materials ne correspond pas a un groupe, le mesh n'est pas modifie.
+ */
+int groupMaterials( Mesh *mesh );
+
+//! ponderation des normales des triangles, cf buildNormals().
+enum
+{
+    NORMAL_UNIFORM= 0,  //!< meme poids pour tous les triangles.
+    NORMAL_AREA,        //!< poids proportionnel a l'aire du triangle.
+    NORMAL_ANGLE        //!< poids proportionnel a l'angle du triangle sur le sommet.
+};
+
+/*! recalcule les normales des sommets : moyenne ponderee des normales des triangles adjacents, cf NORMAL_AREA, NORMAL_ANGLE, NORMAL_UNIFORM.
+ si crease_angle est inferieur a 180 degres, les triangles dont les normales forment un angle superieur a crease_angle ne sont pas lisses ensemble : 
+ les sommets d'une arete vive sont dupliques, indices, positions et texcoords sont mis a jour.
+ */
+int buildNormals( Mesh *mesh, const int weight= NORMAL_AREA, const float crease_angle= 180.f );
 
 }       // namespace
 
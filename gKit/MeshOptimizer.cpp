@@ -0,0 +1,302 @@
+
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#include "MeshOptimizer.h"
+#include "Mesh.h"
+#include "MeshCluster.h"
+
+
+namespace gk {
+
+namespace MeshOptimizer {
+
+float ACMR( const Mesh *mesh, const unsigned int cache_size )
+{
+    if(mesh == NULL || mesh->indices.size() < 3u || cache_size == 0)
+        return 0.f;
+    
+    // cache fifo : date d'insertion de chaque sommet
+    unsigned int vertex_count= 0;
+    for(unsigned int i= 0; i < mesh->indices.size(); i++)
+        vertex_count= std::max(vertex_count, mesh->indices[i] +1u);
+    
+    std::vector<unsigned int> timestamps(vertex_count, 0);
+    unsigned int time= cache_size +1;
+    unsigned int misses= 0;
+    for(unsigned int i= 0; i < mesh->indices.size(); i++)
+    {
+        const unsigned int v= mesh->indices[i];
+        if(time - timestamps[v] > cache_size)
+        {
+            timestamps[v]= time++;
+            misses++;
+        }
+    }
+    
+    return (float) misses / (float) (mesh->indices.size() / 3u);
+}
+
+
+// tipsify, triangles [begin end) d'un groupe.
+static
+void tipsify( const std::vector<unsigned int>& indices, const unsigned int begin, const unsigned int end,
+    const std::vector<unsigned int>& offsets, const std::vector<unsigned int>& adjacency,
+    std::vector<int>& live, std::vector<unsigned int>& timestamps, unsigned int& time, 
+    std::vector<unsigned char>& emitted, const unsigned int cache_size, std::vector<unsigned int>& order )
+{
+    // sommets des triangles du groupe
+    for(unsigned int t= begin; t < end; t++)
+    {
+        emitted[t]= 0;
+        live[indices[3u*t]]++;
+        live[indices[3u*t +1u]]++;
+        live[indices[3u*t +2u]]++;
+    }
+    
+    std::vector<unsigned int> deadend;
+    std::vector<unsigned int> candidates;
+    unsigned int cursor= 3u * begin;
+    int fan= indices[cursor];
+    while(fan >= 0)
+    {
+        // emet les triangles voisins du sommet
+        candidates.clear();
+        for(unsigned int k= offsets[fan]; k < offsets[fan +1]; k++)
+        {
+            const unsigned int t= adjacency[k];
+            if(emitted[t])
+                continue;
+            
+            emitted[t]= 1;
+            order.push_back(t);
+            for(unsigned int i= 0; i < 3; i++)
+            {
+                const unsigned int v= indices[3u*t +i];
+                deadend.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if(time - timestamps[v] > cache_size)
+                    timestamps[v]= time++;
+            }
+        }
+        
+        // choisit le prochain sommet : dans le cache, et avec des triangles a emettre
+        fan= -1;
+        int best= -1;
+        for(unsigned int i= 0; i < candidates.size(); i++)
+        {
+            const unsigned int v= candidates[i];
+            if(live[v] <= 0)
+                continue;
+            
+            int priority= 0;
+            if(time - timestamps[v] + 2u * live[v] <= cache_size)
+                priority= time - timestamps[v];
+            if(priority > best)
+            {
+                best= priority;
+                fan= v;
+            }
+        }
+        
+        if(fan >= 0)
+            continue;
+        
+        // impasse, reprend un sommet recent
+        while(deadend.empty() == false)
+        {
+            const unsigned int v= deadend.back();
+            deadend.pop_back();
+            if(live[v] > 0)
+            {
+                fan= v;
+                break;
+            }
+        }
+        
+        // ou le prochain sommet du groupe
+        for(; fan < 0 && cursor < 3u * end; cursor++)
+            if(live[indices[cursor]] > 0)
+                fan= indices[cursor];
+    }
+}
+
+//! reordonne les triangles de chaque intervalle [ranges[2i] ranges[2i+1]), les intervalles doivent se suivre et couvrir tous les triangles.
+static
+int optimize_ranges( Mesh *mesh, const std::vector<unsigned int>& ranges, const unsigned int cache_size )
+{
+    const std::vector<unsigned int>& indices= mesh->indices;
+    const unsigned int triangles= indices.size() / 3u;
+    if(triangles == 0)
+        return 0;
+    
+    unsigned int vertex_count= 0;
+    for(unsigned int i= 0; i < 3u * triangles; i++)
+        vertex_count= std::max(vertex_count, indices[i] +1u);
+    
+    // triangles adjacents a chaque sommet
+    std::vector<unsigned int> offsets(vertex_count +1, 0);
+    for(unsigned int i= 0; i < 3u * triangles; i++)
+        offsets[indices[i] +1]++;
+    for(unsigned int v= 0; v < vertex_count; v++)
+        offsets[v +1]+= offsets[v];
+    
+    std::vector<unsigned int> adjacency(3u * triangles);
+    {
+        std::vector<unsigned int> next(offsets.begin(), offsets.end() -1);
+        for(unsigned int i= 0; i < 3u * triangles; i++)
+            adjacency[next[indices[i]]++]= i / 3u;
+    }
+    
+    std::vector<int> live(vertex_count, 0);
+    std::vector<unsigned int> timestamps(vertex_count, 0);
+    std::vector<unsigned char> emitted(triangles, 1);   // les triangles des autres groupes ne sont pas emis
+    unsigned int time= cache_size +1;
+    
+    std::vector<unsigned int> order;
+    order.reserve(triangles);
+    for(unsigned int r= 0; r < ranges.size(); r+= 2)
+    {
+        const unsigned int begin= order.size();
+        tipsify(indices, ranges[r], ranges[r +1], offsets, adjacency, live, timestamps, time, emitted, cache_size, order);
+        
+        // les triangles emis occupent la place du groupe
+        if(begin != ranges[r] || order.size() != ranges[r +1])
+            return -1;      // groupes mal formes, ne modifie pas le mesh
+    }
+    
+    if(order.size() != triangles)
+        return -1;
+    
+    std::vector<unsigned int> reordered(3u * triangles);
+    for(unsigned int i= 0; i < triangles; i++)
+    {
+        const unsigned int t= order[i];
+        reordered[3u*i]= indices[3u*t];
+        reordered[3u*i +1u]= indices[3u*t +1u];
+        reordered[3u*i +2u]= indices[3u*t +2u];
+    }
+    mesh->indices.swap(reordered);
+    
+    if(mesh->materials.size() == triangles)
+    {
+        std::vector<int> materials(triangles);
+        for(unsigned int i= 0; i < triangles; i++)
+            materials[i]= mesh->materials[order[i]];
+        mesh->materials.swap(materials);
+    }
+    
+    return 0;
+}
+
+int optimizeVertexCache( Mesh *mesh, const unsigned int cache_size )
+{
+    if(mesh == NULL || cache_size == 0)
+        return -1;
+    
+    // reordonne les triangles de chaque groupe, sans les melanger
+    const unsigned int triangles= mesh->indices.size() / 3u;
+    std::vector<unsigned int> ranges;
+    for(unsigned int g= 0; g < mesh->groups.size(); g++)
+        if(mesh->groups[g].begin < mesh->groups[g].end)
+        {
+            ranges.push_back(mesh->groups[g].begin / 3u);
+            ranges.push_back(std::min(mesh->groups[g].end / 3u, triangles));
+        }
+    if(ranges.empty())
+    {
+        ranges.push_back(0);
+        ranges.push_back(triangles);
+    }
+    
+    return optimize_ranges(mesh, ranges, cache_size);
+}
+
+int optimizeVertexCache( Mesh *mesh, const std::vector<MeshCluster>& clusters, const unsigned int cache_size )
+{
+    if(mesh == NULL || cache_size == 0)
+        return -1;
+    if(clusters.empty())
+        return optimizeVertexCache(mesh, cache_size);
+    
+    // reordonne les triangles de chaque cluster, sans les melanger
+    std::vector<unsigned int> ranges;
+    for(unsigned int i= 0; i < clusters.size(); i++)
+        if(clusters[i].begin < clusters[i].end)
+        {
+            ranges.push_back(clusters[i].begin / 3u);
+            ranges.push_back(clusters[i].end / 3u);
+        }
+    
+    return optimize_ranges(mesh, ranges, cache_size);
+}
+
+
+//! reordonne un attribut de sommet, remap[i] : nouvelle position du sommet i.
+template < typename T >
+static
+void reorder( std::vector<T>& attribute, const std::vector<unsigned int>& remap )
+{
+    if(attribute.size() != remap.size())
+        return;
+    
+    std::vector<T> tmp(attribute.size());
+    for(unsigned int i= 0; i < attribute.size(); i++)
+        tmp[remap[i]]= attribute[i];
+    attribute.swap(tmp);
+}
+
+int optimizeVertexFetch( Mesh *mesh )
+{
+    if(mesh == NULL)
+        return -1;
+    
+    const unsigned int vertex_count= mesh->positions.size();
+    for(unsigned int i= 0; i < mesh->indices.size(); i++)
+        if(mesh->indices[i] >= vertex_count)
+            return -1;
+    
+    // numerote les sommets dans l'ordre d'utilisation
+    std::vector<unsigned int> remap(vertex_count, ~0u);
+    unsigned int next= 0;
+    for(unsigned int i= 0; i < mesh->indices.size(); i++)
+    {
+        unsigned int& v= remap[mesh->indices[i]];
+        if(v == ~0u)
+            v= next++;
+        mesh->indices[i]= v;
+    }
+    
+    // puis les sommets inutilises
+    for(unsigned int i= 0; i < vertex_count; i++)
+        if(remap[i] == ~0u)
+            remap[i]= next++;
+    
+    reorder(mesh->positions, remap);
+    reorder(mesh->texcoords, remap);
+    reorder(mesh->normals, remap);
+    return 0;
+}
+
+
+int optimize( Mesh *mesh, const unsigned int cache_size )
+{
+    if(mesh == NULL)
+        return -1;
+    
+    const float before= ACMR(mesh, cache_size);
+    if(optimizeVertexCache(mesh, cache_size) < 0 || optimizeVertexFetch(mesh) < 0)
+    {
+        printf("optimizing mesh... failed.\n");
+        return -1;
+    }
+    
+    printf("optimizing mesh... ACMR %.3f -> %.3f, cache %u\n", before, ACMR(mesh, cache_size), cache_size);
+    return 0;
+}
+
+}       // namespace
+
+}       // namespace
@@ -0,0 +1,38 @@
+
+#ifndef _MESH_OPTIMIZER_H
+#define _MESH_OPTIMIZER_H
+
+#include <vector>
+
+
+namespace gk {
+
+struct Mesh;
+struct MeshCluster;
+
+//! reorganisation des triangles et des sommets d'un mesh pour les caches du gpu.
+namespace MeshOptimizer {
+
+//! renvoie le nombre moyen de sommets transformes par triangle (ACMR), pour un cache fifo de cache_size sommets. entre 0.5 et 3, le plus petit est le mieux.
+float ACMR( const Mesh *mesh, const unsigned int cache_size= 16 );
+
+/*! reordonne les triangles pour reutiliser les sommets presents dans le cache de sommets transformes, cf "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw",
+ P. Sander, D. Nehab, J. Barczak, 2007 (tipsify). les triangles ne changent pas de groupe, materials reste valide.
+ */
+int optimizeVertexCache( Mesh *mesh, const unsigned int cache_size= 16 );
+
+//! reordonne les triangles de chaque cluster, sans les melanger, cf MeshClusters::build(). les clusters restent valides.
+int optimizeVertexCache( Mesh *mesh, const std::vector<MeshCluster>& clusters, const unsigned int cache_size= 16 );
+
+//! renumerote les sommets dans l'ordre de leur premiere utilisation par indices, et reordonne positions, texcoords et normals.
+//! les sommets inutilises sont places a la fin.
+int optimizeVertexFetch( Mesh *mesh );
+
+//! optimizeVertexCache() + optimizeVertexFetch(), affiche l'ACMR avant et apres.
+int optimize( Mesh *mesh, const unsigned int cache_size= 16 );
+
+}       // namespace
+
+}       // namespace
+
+#endif
@@ -0,0 +1,225 @@
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include "MeshPacking.h"
+#include "Mesh.h"
+
+
+namespace gk {
+
+namespace MeshPacking {
+
+unsigned short quantize( const float v, const float vmin, const float vmax )
+{
+    if(vmax <= vmin)
+        return 0;
+
+    float t= (v - vmin) / (vmax - vmin);
+    t= std::min(std::max(t, 0.f), 1.f);
+    return (unsigned short) (t * 65535.f + .5f);
+}
+
+float dequantize( const unsigned short q, const float vmin, const float vmax )
+{
+    return vmin + (float) q / 65535.f * (vmax - vmin);
+}
+
+
+unsigned short floatToHalf( const float f )
+{
+    unsigned int u;
+    memcpy(&u, &f, sizeof(u));
+
+    const unsigned int sign= (u >> 16) & 0x8000u;
+    const unsigned int e= (u >> 23) & 0xFFu;
+    unsigned int mantissa= u & 0x7FFFFFu;
+
+    if(e == 0xFFu)
+        // inf, nan
+        return (unsigned short) (sign | 0x7C00u | (mantissa ? 0x200u : 0u));
+
+    const int exponent= (int) e - 127 + 15;
+    if(exponent >= 31)
+        // trop grand, inf
+        return (unsigned short) (sign | 0x7C00u);
+
+    if(exponent <= 0)
+    {
+        // denormalise
+        if(exponent < -10)
+            return (unsigned short) sign;
+
+        mantissa|= 0x800000u;
+        const unsigned int shift= 14 - exponent;
+        unsigned int h= mantissa >> shift;
+        const unsigned int rest= mantissa & ((1u << shift) -1u);
+        const unsigned int half= 1u << (shift -1u);
+        if(rest > half || (rest == half && (h & 1u)))
+            h++;
+        return (unsigned short) (sign | h);
+    }
+
+    // arrondi au plus proche, pair en cas d'egalite. le depassement eventuel de la mantisse incremente l'exposant, inf si necessaire.
+    unsigned int h= ((unsigned int) exponent << 10) | (mantissa >> 13);
+    const unsigned int rest= mantissa & 0x1FFFu;
+    if(rest > 0x1000u || (rest == 0x1000u && (h & 1u)))
+        h++;
+    return (unsigned short) (sign | h);
+}
+
+float halfToFloat( const unsigned short h )
+{
+    const unsigned int sign= ((unsigned int) h & 0x8000u) << 16;
+    const unsigned int exponent= ((unsigned int) h >> 10) & 0x1Fu;
+    const unsigned int mantissa= (unsigned int) h & 0x3FFu;
+
+    if(exponent == 0)
+    {
+        // zero ou denormalise
+        const float f= ldexpf((float) mantissa, -24);
+        return sign ? -f : f;
+    }
+
+    unsigned int u;
+    if(exponent == 31)
+        u= sign | 0x7F800000u | (mantissa << 13);
+    else
+        u= sign | ((exponent + 112u) << 23) | (mantissa << 13);
+
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+
+static
+short snorm16( const float v )
+{
+    const float t= std::min(std::max(v, -1.f), 1.f);
+    return (short) floorf(t * 32767.f + .5f);
+}
+
+static
+float sign_not_zero( const float v )
+{
+    return (v < 0.f) ? -1.f : 1.f;
+}
+
+void encodeOctahedral( const Vec3& n, short encoded[2] )
+{
+    const float l1= fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+    if(l1 == 0.f)
+    {
+        // direction nulle, encode +z
+        encoded[0]= 0;
+        encoded[1]= 0;
+        return;
+    }
+
+    // projection sur l'octaedre, puis depliage de l'hemisphere inferieur
+    float x= n.x / l1;
+    float y= n.y / l1;
+    if(n.z < 0.f)
+    {
+        const float px= x;
+        x= (1.f - fabsf(y)) * sign_not_zero(px);
+        y= (1.f - fabsf(px)) * sign_not_zero(y);
+    }
+
+    encoded[0]= snorm16(x);
+    encoded[1]= snorm16(y);
+}
+
+Vec3 decodeOctahedral( const short encoded[2] )
+{
+    const float x= std::max((float) encoded[0] / 32767.f, -1.f);
+    const float y= std::max((float) encoded[1] / 32767.f, -1.f);
+
+    Vec3 n(x, y, 1.f - fabsf(x) - fabsf(y));
+    const float t= std::max(-n.z, 0.f);
+    n.x+= (n.x >= 0.f) ? -t : t;
+    n.y+= (n.y >= 0.f) ? -t : t;
+
+    const float length= sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+    return Vec3(n.x / length, n.y / length, n.z / length);
+}
+
+
+int pack( const Mesh *mesh, PackedMesh& packed )
+{
+    if(mesh == NULL || mesh->positions.empty())
+        return -1;
+
+    const unsigned int count= mesh->positions.size();
+    packed.bbox.clear();
+    for(unsigned int i= 0; i < count; i++)
+        packed.bbox.Union(Point(mesh->positions[i]));
+
+    const Point& pmin= packed.bbox.pMin;
+    const Point& pmax= packed.bbox.pMax;
+
+    packed.vertices.resize(count);
+    #pragma omp parallel for schedule(static)
+    for(int i= 0; i < (int) count; i++)
+    {
+        PackedVertex& v= packed.vertices[i];
+
+        const Vec3& p= mesh->positions[i];
+        v.position[0]= quantize(p.x, pmin.x, pmax.x);
+        v.position[1]= quantize(p.y, pmin.y, pmax.y);
+        v.position[2]= quantize(p.z, pmin.z, pmax.z);
+        v.position[3]= 0;
+
+        if(i < (int) mesh->texcoords.size())
+        {
+            v.texcoord[0]= floatToHalf(mesh->texcoords[i].x);
+            v.texcoord[1]= floatToHalf(mesh->texcoords[i].y);
+        }
+        else
+        {
+            v.texcoord[0]= 0;
+            v.texcoord[1]= 0;
+        }
+
+        if(i < (int) mesh->normals.size())
+            encodeOctahedral(mesh->normals[i], v.normal);
+        else
+            encodeOctahedral(Vec3(0.f, 0.f, 1.f), v.normal);
+    }
+
+    return 0;
+}
+
+int unpack( const PackedMesh& packed, Mesh *mesh )
+{
+    if(mesh == NULL)
+        return -1;
+
+    const Point& pmin= packed.bbox.pMin;
+    const Point& pmax= packed.bbox.pMax;
+
+    const unsigned int count= packed.vertices.size();
+    mesh->positions.resize(count);
+    mesh->texcoords.resize(count);
+    mesh->normals.resize(count);
+
+    #pragma omp parallel for schedule(static)
+    for(int i= 0; i < (int) count; i++)
+    {
+        const PackedVertex& v= packed.vertices[i];
+        mesh->positions[i]= Vec3(
+            dequantize(v.position[0], pmin.x, pmax.x),
+            dequantize(v.position[1], pmin.y, pmax.y),
+            dequantize(v.position[2], pmin.z, pmax.z));
+        mesh->texcoords[i]= Vec3(halfToFloat(v.texcoord[0]), halfToFloat(v.texcoord[1]), 0.f);
+        mesh->normals[i]= decodeOctahedral(v.normal);
+    }
+
+    return 0;
+}
+
+}       // namespace
+
+}       // namespace
@@ -0,0 +1,63 @@
+
+#ifndef _MESH_PACKING_H
+#define _MESH_PACKING_H
+
+#include <vector>
+
+#include "Vec.h"
+#include "Geometry.h"
+
+
+namespace gk {
+
+struct Mesh;
+
+/*! sommet compresse, 16 octets au lieu de 36 (3 Vec3) :
+    - position quantifiee sur 16 bits par axe, relativement a la bbox du mesh, cf PackedMesh::bbox,
+    - texcoord en half float,
+    - normale en encodage octaedrique, 2 x snorm16.
+ */
+struct PackedVertex
+{
+    unsigned short position[4];         //!< x, y, z, 0 : [0 .. 65535] dans la bbox. 4 composantes pour aligner l'attribut sur 8 octets.
+    unsigned short texcoord[2];         //!< u, v en half float.
+    short normal[2];                    //!< encodage octaedrique, [-32767 .. 32767].
+};
+
+//! mesh compresse : sommets + bbox utilisee pour quantifier les positions.
+struct PackedMesh
+{
+    BBox bbox;                          //!< englobant des positions, position= bbox.pMin + p * (bbox.pMax - bbox.pMin).
+    std::vector<PackedVertex> vertices; //!< sommets, indexes par les indices du mesh d'origine.
+
+    PackedMesh( ) : bbox(), vertices() {}
+};
+
+//! compression des attributs de sommets.
+namespace MeshPacking {
+
+//! quantifie v dans [vmin vmax] sur 16 bits.
+unsigned short quantize( const float v, const float vmin, const float vmax );
+//! inverse de quantize().
+float dequantize( const unsigned short q, const float vmin, const float vmax );
+
+//! conversion float 32 bits vers half float 16 bits, arrondi au plus proche.
+unsigned short floatToHalf( const float f );
+//! conversion half float 16 bits vers float 32 bits.
+float halfToFloat( const unsigned short h );
+
+//! encodage octaedrique d'une direction, cf "A Survey of Efficient Representations for Independent Unit Vectors", Z. Cigolle, S. Donow, D. Evangelakos, 2014.
+void encodeOctahedral( const Vec3& n, short encoded[2] );
+//! inverse de encodeOctahedral(), renvoie une direction normalisee.
+Vec3 decodeOctahedral( const short encoded[2] );
+
+//! compresse les sommets d'un mesh, les indices ne changent pas. renvoie -1 en cas d'erreur.
+int pack( const Mesh *mesh, PackedMesh& packed );
+//! decompresse les sommets, remplace positions, texcoords et normals du mesh.
+int unpack( const PackedMesh& packed, Mesh *mesh );
+
+}       // namespace
+
+}       // namespace
+
+#endif
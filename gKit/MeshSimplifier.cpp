@@ -0,0 +1,392 @@
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "MeshSimplifier.h"
+#include "MeshAdjacency.h"
+#include "Transform.h"
+
+
+namespace gk {
+
+namespace MeshSimplifier {
+
+//! quadrique symetrique : somme des carres des distances aux plans des triangles, ponderes par leur aire.
+struct quadric
+{
+    double a2, ab, ac, ad;
+    double b2, bc, bd;
+    double c2, cd;
+    double d2;
+    double w;           //!< somme des poids.
+
+    quadric( ) : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0), w(0) {}
+
+    //! quadrique du plan ax + by + cz + d = 0, de poids weight.
+    quadric( const double a, const double b, const double c, const double d, const double weight )
+        :
+        a2(a*a*weight), ab(a*b*weight), ac(a*c*weight), ad(a*d*weight),
+        b2(b*b*weight), bc(b*c*weight), bd(b*d*weight),
+        c2(c*c*weight), cd(c*d*weight),
+        d2(d*d*weight),
+        w(weight)
+    {}
+
+    quadric& operator+= ( const quadric& q )
+    {
+        a2+= q.a2; ab+= q.ab; ac+= q.ac; ad+= q.ad;
+        b2+= q.b2; bc+= q.bc; bd+= q.bd;
+        c2+= q.c2; cd+= q.cd;
+        d2+= q.d2;
+        w+= q.w;
+        return *this;
+    }
+
+    //! renvoie le carre de la distance moyenne de p aux plans.
+    double error( const Vec3& p ) const
+    {
+        if(w <= 0)
+            return 0;
+
+        const double x= p.x, y= p.y, z= p.z;
+        const double e= a2*x*x + 2*ab*x*y + 2*ac*x*z + 2*ad*x
+            + b2*y*y + 2*bc*y*z + 2*bd*y
+            + c2*z*z + 2*cd*z
+            + d2;
+        return std::max(e, 0.0) / w;
+    }
+};
+
+//! contraction d'arete : le sommet u est deplace sur le sommet v.
+struct collapse
+{
+    double cost;
+    unsigned int u;
+    unsigned int v;
+
+    collapse( ) : cost(0), u(0), v(0) {}
+    collapse( const double _cost, const unsigned int _u, const unsigned int _v ) : cost(_cost), u(_u), v(_v) {}
+
+    bool operator< ( const collapse& b ) const
+    {
+        return cost < b.cost;
+    }
+};
+
+static
+Vec3 triangle_normal( const Vec3& a, const Vec3& b, const Vec3& c )
+{
+    const float abx= b.x - a.x, aby= b.y - a.y, abz= b.z - a.z;
+    const float acx= c.x - a.x, acy= c.y - a.y, acz= c.z - a.z;
+    return Vec3(aby * acz - abz * acy, abz * acx - abx * acz, abx * acy - aby * acx);
+}
+
+static
+float dot( const Vec3& a, const Vec3& b )
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+//! verifie que les triangles autour de u ne se retournent pas si u est deplace sur v.
+static
+bool flips( const Mesh *mesh, const std::vector<int>& ring, const unsigned int u, const unsigned int v )
+{
+    const Vec3& pv= mesh->positions[v];
+    for(unsigned int i= 0; i < ring.size(); i++)
+    {
+        const unsigned int *t= &mesh->indices[3 * ring[i]];
+        if(t[0] == v || t[1] == v || t[2] == v)
+            continue;   // triangle supprime par la contraction
+
+        const Vec3& a= mesh->positions[t[0]];
+        const Vec3& b= mesh->positions[t[1]];
+        const Vec3& c= mesh->positions[t[2]];
+        const Vec3 n= triangle_normal(a, b, c);
+        const Vec3 m= triangle_normal(t[0] == u ? pv : a, t[1] == u ? pv : b, t[2] == u ? pv : c);
+
+        // rejette les triangles retournes ou presque degeneres
+        const float nn= dot(n, n);
+        const float mm= dot(m, m);
+        if(nn > 0.f && (mm == 0.f || dot(n, m) < .25f * sqrtf(nn * mm)))
+            return true;
+    }
+
+    return false;
+}
+
+float simplify( Mesh *mesh, const unsigned int target )
+{
+    if(mesh == NULL)
+        return -1.f;
+
+    const unsigned int vertex_count= mesh->positions.size();
+    const unsigned int triangle_count= mesh->indices.size() / 3u;
+    for(unsigned int i= 0; i < 3u * triangle_count; i++)
+        if(mesh->indices[i] >= vertex_count)
+        {
+            printf("MeshSimplifier::simplify( ): invalid index %u, %u vertices.\n", mesh->indices[i], vertex_count);
+            return -1.f;
+        }
+
+    mesh->indices.resize(3u * triangle_count);
+
+    // groupe de chaque triangle, et triangle d'origine, pour reconstruire materials et groups
+    const bool materials= (mesh->materials.size() == triangle_count);
+    std::vector<int> groups(triangle_count, -1);
+    std::vector<unsigned int> origins(triangle_count);
+    for(unsigned int i= 0; i < triangle_count; i++)
+        origins[i]= i;
+    if(materials)
+        groups= mesh->materials;
+    else
+        for(unsigned int g= 0; g < mesh->groups.size(); g++)
+            for(unsigned int i= mesh->groups[g].begin / 3u; i < mesh->groups[g].end / 3u && i < triangle_count; i++)
+                groups[i]= g;
+
+    // quadriques des sommets
+    std::vector<quadric> quadrics(vertex_count);
+    for(unsigned int i= 0; i < triangle_count; i++)
+    {
+        const unsigned int *t= &mesh->indices[3u * i];
+        const Vec3& a= mesh->positions[t[0]];
+        const Vec3 n= triangle_normal(a, mesh->positions[t[1]], mesh->positions[t[2]]);
+        const double length= sqrt((double) dot(n, n));
+        if(length == 0)
+            continue;
+
+        const double nx= n.x / length, ny= n.y / length, nz= n.z / length;
+        const quadric q(nx, ny, nz, -(nx * a.x + ny * a.y + nz * a.z), length / 2);
+        for(int k= 0; k < 3; k++)
+            quadrics[t[k]]+= q;
+    }
+
+    double error= 0;
+    unsigned int triangles= triangle_count;
+
+    MeshAdjacency adjacency;
+    std::vector<unsigned int> valence;
+    std::vector<collapse> candidates;
+    std::vector<unsigned char> locked;
+    std::vector<unsigned char> removed;
+    std::vector<int> ring;
+    std::vector<unsigned int> neighbours;
+    std::vector<unsigned int> vneighbours;
+    while(triangles > target)
+    {
+        // les contractions d'une passe ne partagent pas de triangles, l'adjacence reste valide pendant toute la passe
+        if(adjacency.build(mesh) < 0)
+            return -1.f;
+
+        valence.assign(vertex_count, 0);
+        for(unsigned int i= 0; i < mesh->indices.size(); i++)
+            valence[mesh->indices[i]]++;
+
+        // meilleure contraction de chaque sommet interieur
+        candidates.clear();
+        for(unsigned int u= 0; u < vertex_count; u++)
+        {
+            const int c= adjacency.corner(u);
+            if(c < 0 || adjacency.boundary(MeshAdjacency::next(c)))
+                continue;       // sommet inutilise ou eventail ouvert : bord, couture
+            if(adjacency.vertexTriangles(u, ring) != (int) valence[u])
+                continue;       // plusieurs eventails, sommet non manifold
+
+            bool border= false;
+            for(unsigned int i= 1; i < ring.size(); i++)
+                if(groups[ring[i]] != groups[ring[0]])
+                    border= true;
+            if(border)
+                continue;       // frontiere entre matieres
+
+            adjacency.vertexNeighbours(u, neighbours);
+            double cost= HUGE_VAL;
+            unsigned int best= u;
+            for(unsigned int i= 0; i < neighbours.size(); i++)
+            {
+                const unsigned int v= neighbours[i];
+                quadric q= quadrics[u];
+                q+= quadrics[v];
+                const double e= q.error(mesh->positions[v]);
+                if(e < cost && !flips(mesh, ring, u, v))
+                {
+                    cost= e;
+                    best= v;
+                }
+            }
+
+            if(best != u)
+                candidates.push_back( collapse(cost, u, best) );
+        }
+
+        if(candidates.empty())
+            break;
+        std::sort(candidates.begin(), candidates.end());
+
+        locked.assign(vertex_count, 0);
+        removed.assign(mesh->indices.size() / 3u, 0);
+        int collapses= 0;
+        for(unsigned int i= 0; i < candidates.size() && triangles > target; i++)
+        {
+            const unsigned int u= candidates[i].u;
+            const unsigned int v= candidates[i].v;
+            if(locked[u] || locked[v])
+                continue;
+
+            // condition de lien : u et v ne partagent que les 2 sommets opposes a l'arete, sinon la contraction cree une arete non manifold
+            adjacency.vertexNeighbours(u, neighbours);
+            if(adjacency.vertexNeighbours(v, vneighbours) == 0 || adjacency.vertexTriangles(v, ring) != (int) valence[v])
+                continue;
+
+            int shared= 0;
+            for(unsigned int k= 0; k < neighbours.size(); k++)
+                if(std::find(vneighbours.begin(), vneighbours.end(), neighbours[k]) != vneighbours.end())
+                    shared++;
+            if(shared != 2)
+                continue;
+
+            // deplace u sur v, les triangles de l'arete disparaissent
+            adjacency.vertexTriangles(u, ring);
+            for(unsigned int k= 0; k < ring.size(); k++)
+            {
+                unsigned int *t= &mesh->indices[3 * ring[k]];
+                if(t[0] == v || t[1] == v || t[2] == v)
+                {
+                    removed[ring[k]]= 1;
+                    triangles--;
+                }
+
+                for(int j= 0; j < 3; j++)
+                    if(t[j] == u)
+                        t[j]= v;
+            }
+
+            quadrics[v]+= quadrics[u];
+            error= std::max(error, candidates[i].cost);
+
+            locked[u]= 1;
+            locked[v]= 1;
+            for(unsigned int k= 0; k < neighbours.size(); k++)
+                locked[neighbours[k]]= 1;
+            collapses++;
+        }
+
+        if(collapses == 0)
+            break;
+
+        // supprime les triangles degeneres
+        unsigned int n= 0;
+        for(unsigned int i= 0; i < removed.size(); i++)
+        {
+            if(removed[i])
+                continue;
+
+            mesh->indices[3*n]= mesh->indices[3*i];
+            mesh->indices[3*n +1]= mesh->indices[3*i +1];
+            mesh->indices[3*n +2]= mesh->indices[3*i +2];
+            groups[n]= groups[i];
+            origins[n]= origins[i];
+            n++;
+        }
+        mesh->indices.resize(3*n);
+        groups.resize(n);
+        origins.resize(n);
+    }
+
+    // reconstruit materials et groups, l'ordre des triangles est conserve
+    if(materials)
+        mesh->materials= groups;
+    for(unsigned int g= 0; g < mesh->groups.size(); g++)
+    {
+        mesh->groups[g].begin= 3u * (std::lower_bound(origins.begin(), origins.end(), mesh->groups[g].begin / 3u) - origins.begin());
+        mesh->groups[g].end= 3u * (std::lower_bound(origins.begin(), origins.end(), mesh->groups[g].end / 3u) - origins.begin());
+    }
+
+    return (float) sqrt(error);
+}
+
+
+int buildLODs( const Mesh *mesh, std::vector<MeshLOD>& lods, const int levels, const float ratio )
+{
+    lods.clear();
+    if(mesh == NULL || mesh->indices.size() < 3u || levels < 1)
+        return -1;
+
+    // copie de travail, sans les attributs inutiles
+    Mesh work;
+    work.positions= mesh->positions;
+    work.indices= mesh->indices;
+    work.materials= mesh->materials;
+    work.groups= mesh->groups;
+
+    lods.push_back( MeshLOD() );
+    lods.back().indices= mesh->indices;
+    lods.back().groups= mesh->groups;
+
+    float error= 0.f;
+    for(int level= 1; level < levels; level++)
+    {
+        const unsigned int count= work.indices.size() / 3u;
+        const float e= simplify(&work, (unsigned int) (count * ratio));
+        if(e < 0.f)
+            return -1;
+        if(work.indices.size() / 3u >= count)
+            break;      // plus de simplification possible
+
+        // l'erreur est mesuree par rapport au niveau precedent
+        error+= e;
+
+        lods.push_back( MeshLOD() );
+        lods.back().indices= work.indices;
+        lods.back().groups= work.groups;
+        lods.back().error= error;
+
+        printf("  lod %d: %u triangles, error %f\n", level, (unsigned int) work.indices.size() / 3u, error);
+    }
+
+    return (int) lods.size();
+}
+
+int selectLOD( const std::vector<MeshLOD>& lods, const BBox& bbox, const Transform& mvp,
+    const float width, const float height, const float pixel_error )
+{
+    if(lods.size() < 2)
+        return 0;
+
+    // englobant de la projection de la bbox
+    float xmin= HUGE_VAL, ymin= HUGE_VAL;
+    float xmax= -HUGE_VAL, ymax= -HUGE_VAL;
+    for(int i= 0; i < 8; i++)
+    {
+        const Point p((i & 1) ? bbox.pMax.x : bbox.pMin.x, (i & 2) ? bbox.pMax.y : bbox.pMin.y, (i & 4) ? bbox.pMax.z : bbox.pMin.z);
+        HPoint h;
+        mvp(p, h);
+        if(h.w <= 0.f)
+            return 0;   // la camera est dans l'englobant, ou derriere
+
+        xmin= std::min(xmin, h.x / h.w);
+        xmax= std::max(xmax, h.x / h.w);
+        ymin= std::min(ymin, h.y / h.w);
+        ymax= std::max(ymax, h.y / h.w);
+    }
+
+    // nombre de pixels par unite du repere objet
+    const float pixels= std::max((xmax - xmin) * width, (ymax - ymin) * height) / 2.f;
+    const Vector diagonal(bbox.pMin, bbox.pMax);
+    const float length= diagonal.Length();
+    if(length == 0.f)
+        return (int) lods.size() -1;
+
+    const float scale= pixels / length;
+    int lod= 0;
+    for(unsigned int i= 1; i < lods.size(); i++)
+        if(lods[i].error * scale <= pixel_error)
+            lod= i;
+
+    return lod;
+}
+
+}       // namespace
+
+}       // namespace
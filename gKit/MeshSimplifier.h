@@ -0,0 +1,51 @@
+
+#ifndef _MESH_SIMPLIFIER_H
+#define _MESH_SIMPLIFIER_H
+
+#include <vector>
+
+#include "Geometry.h"
+#include "Mesh.h"
+
+
+namespace gk {
+
+class Transform;
+
+//! niveau de detail d'un mesh : triangles simplifies, utilisant les sommets du mesh d'origine, cf MeshSimplifier::buildLODs().
+struct MeshLOD
+{
+    std::vector<unsigned int> indices;  //!< triangles du niveau de detail, indexent positions, texcoords et normals du mesh d'origine.
+    std::vector<MeshGroup> groups;      //!< groupes de faces associes a une matiere, begin et end indexent indices.
+    float error;                        //!< erreur geometrique par rapport au mesh d'origine, distance dans le repere du mesh.
+
+    MeshLOD( ) : indices(), groups(), error(0.f) {}
+};
+
+//! simplification de mesh par contraction d'aretes.
+namespace MeshSimplifier {
+
+/*! simplifie le mesh jusqu'a target triangles, si possible. cf "Surface Simplification Using Quadric Error Metrics", M. Garland, P. Heckbert, 1997.
+ chaque contraction deplace un sommet sur un de ses voisins, les attributs des sommets conserves ne sont pas modifies.
+ seuls les sommets interieurs, entoures d'un eventail ferme de triangles du meme groupe, sont supprimes : les bords, les coutures des coordonnees de textures
+ ou des normales (sommets dupliques) et les frontieres entre matieres sont preserves.
+
+ modifie indices, materials et groups, les sommets inutilises ne sont pas supprimes. renvoie l'erreur geometrique introduite, ou -1 en cas d'erreur.
+ */
+float simplify( Mesh *mesh, const unsigned int target );
+
+//! construit levels niveaux de detail, chaque niveau contient ratio fois moins de triangles que le precedent. lods[0] correspond au mesh d'origine.
+//! renvoie le nombre de niveaux construits, ou -1 en cas d'erreur.
+int buildLODs( const Mesh *mesh, std::vector<MeshLOD>& lods, const int levels= 4, const float ratio= 0.5f );
+
+/*! selectionne le niveau de detail le plus simple dont l'erreur projetee reste inferieure a pixel_error pixels.
+ bbox : englobant du mesh, mvp : transformation du repere objet vers le repere projectif, width, height : dimensions de l'image.
+ */
+int selectLOD( const std::vector<MeshLOD>& lods, const BBox& bbox, const Transform& mvp,
+    const float width, const float height, const float pixel_error= 1.f );
+
+}       // namespace
+
+}       // namespace
+
+#endif
@@ -0,0 +1,387 @@
+
+// mesure des performances de la grille de voxels : chargement, acces aux voxels, insertion.
+// usage : grid_perf [regions par cote= 4] [densite des blocks= 0.5] [densite des voxels= 0.3]
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <time.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "Grid.h"
+
+
+//! utilitaire, mesure le temps ecoule entre les appels start() et stop() en nano secondes.
+struct Timer
+{
+    timespec base;
+
+    Timer( ) { start(); }       //!< demarre automatiquement le timer.
+    ~Timer( ) {}
+
+    void start( )       //!< redemarre le timer.
+    {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &base);
+    }
+
+    uint64_t stop( )    //!< renvoie le temps ecoule depuis start() en nano secondes.
+    {
+        timespec b;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &b);
+
+        return uint64_t(b.tv_sec - base.tv_sec) * uint64_t(1000000000) + uint64_t(b.tv_nsec) - uint64_t(base.tv_nsec);
+    }
+};
+
+//! affiche le temps par operation et le debit.
+static
+void report( const char *label, const uint64_t time, const long int operations, const double bytes= 0 )
+{
+    double ns= (double) time / (double) operations;
+    if(bytes > 0)
+        printf("  %-32s %10.2f ns/op  %10.2f MB/s  (%ld ops, %.2f ms)\n", label, ns, bytes / ((double) time / 1e9) / (1024.0 * 1024.0), operations, time / 1e6);
+    else
+        printf("  %-32s %10.2f ns/op  (%ld ops, %.2f ms)\n", label, ns, operations, time / 1e6);
+}
+
+//! generateur pseudo aleatoire reproductible.
+static unsigned int seed= 1;
+static
+unsigned int next( )
+{
+    seed= seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+static
+float uniform( )
+{
+    return (float) (next() & 0xFFFFFF) / (float) 0x1000000;
+}
+
+//! enregistre une region au format .gkmc version 1 : taille des donnees, index des blocks (ordre y, z, x), blocks non compresses.
+static
+int write_v1( const std::string& filename, const Region& region )
+{
+    std::vector<short> index(4096, -1);
+    std::vector<unsigned char> voxels;
+    int i= 0;
+    for(int by= 0; by < 16; by++)
+    for(int bz= 0; bz < 16; bz++)
+    for(int bx= 0; bx < 16; bx++, i++)
+    {
+        const int id= region.blocks[by * 256 + bx * 16 + bz];
+        if(id < 0)
+            continue;
+
+        index[i]= (short) (voxels.size() / 4096);
+        voxels.resize(voxels.size() + 4096);
+        region.data[id].decompress(&voxels[voxels.size() - 4096]);
+    }
+
+    FILE *out= fopen(filename.c_str(), "wb");
+    if(out == NULL)
+        return -1;
+
+    const int size= (int) voxels.size();
+    bool error= (fwrite(&size, sizeof(int), 1, out) != 1)
+        || (fwrite(&index.front(), sizeof(short), 4096, out) != 4096)
+        || (size > 0 && fwrite(&voxels.front(), 1, size, out) != (size_t) size);
+    fclose(out);
+    return error ? -1 : 0;
+}
+
+//! enregistre toutes les regions du monde au format version 1, cf World::saveMap().
+static
+int saveMap_v1( const World& world, const std::string& pathname )
+{
+    FILE *out= fopen((pathname + ".txt").c_str(), "wt");
+    if(out == NULL)
+        return -1;
+
+    bool error= false;
+    for(unsigned int m= 0; m < world.data.size(); m++)
+    for(unsigned int r= 0; r < world.data[m].data.size(); r++)
+    {
+        const Region& region= world.data[m].data[r];
+
+        char tmp[1024];
+        sprintf(tmp, "r.%d.%d.gkmc", region.bbox.pMin.x / 256, region.bbox.pMin.z / 256);
+        if(write_v1(pathname + "/" + tmp, region) < 0)
+            error= true;
+        else
+            fprintf(out, "%s\n", tmp);
+    }
+
+    fclose(out);
+    return error ? -1 : 0;
+}
+
+//! renvoie la taille des fichiers des regions enregistrees dans pathname.
+static
+size_t map_size( const std::string& pathname, const int rmin, const int rmax )
+{
+    size_t bytes= 0;
+    for(int rx= rmin; rx < rmax; rx++)
+    for(int rz= rmin; rz < rmax; rz++)
+    {
+        char tmp[1024];
+        sprintf(tmp, "%s/r.%d.%d.gkmc", pathname.c_str(), rx, rz);
+
+        struct stat info;
+        if(stat(tmp, &info) == 0)
+            bytes+= info.st_size;
+    }
+
+    return bytes;
+}
+
+
+int main( int argc, char **argv )
+{
+    int regions= 4;
+    float block_density= 0.5f;
+    float voxel_density= 0.3f;
+    if(argc > 1) regions= atoi(argv[1]);
+    if(argc > 2) block_density= (float) atof(argv[2]);
+    if(argc > 3) voxel_density= (float) atof(argv[3]);
+    if(regions < 1) regions= 1;
+
+    printf("grid_perf: %dx%d regions, block density %.2f, voxel density %.2f\n", regions, regions, block_density, voxel_density);
+
+    // genere les blocks, centres sur l'origine du monde
+    const int rmin= -regions / 2;
+    const int rmax= rmin + regions;
+    std::vector<Block> blocks;
+    {
+        unsigned char voxels[4096];
+        for(int rx= rmin; rx < rmax; rx++)
+        for(int rz= rmin; rz < rmax; rz++)
+        for(int by= 0; by < 16; by++)
+        for(int bx= 0; bx < 16; bx++)
+        for(int bz= 0; bz < 16; bz++)
+        {
+            if(uniform() >= block_density)
+                continue;
+
+            // quelques materiaux, en couches, pour obtenir des palettes realistes
+            for(int i= 0; i < 4096; i++)
+                voxels[i]= (uniform() < voxel_density) ? (unsigned char) (1 + (i >> 8) % 4) : 0;
+
+            Gridpoint pmin(rx*256 + bx*16, by*16, rz*256 + bz*16);
+            blocks.push_back( Block(Gridbox(pmin, Gridpoint(pmin.x + 15, pmin.y + 15, pmin.z + 15)), voxels) );
+        }
+    }
+    printf("%u blocks.\n", (unsigned int) blocks.size());
+    if(blocks.empty())
+        return 0;
+
+    printf("\ninsertion:\n");
+    World world;
+    {
+        Timer timer;
+        for(unsigned int i= 0; i < blocks.size(); i++)
+            world.insert(blocks[i]);
+        report("World::insert( Block )", timer.stop(), blocks.size(), (double) blocks.size() * 4096);
+    }
+
+    size_t memory= 0;
+    for(unsigned int m= 0; m < world.data.size(); m++)
+    for(unsigned int r= 0; r < world.data[m].data.size(); r++)
+        memory+= world.data[m].data[r].memory();
+    printf("  memory %.2f MB, %.2f MB uncompressed\n", memory / (1024.0 * 1024.0), blocks.size() * 4096.0 / (1024.0 * 1024.0));
+
+    printf("\nchargement:\n");
+    {
+        const std::string pathname= "grid_perf_map";
+        mkdir(pathname.c_str(), 0755);
+
+        Timer timer;
+        if(world.saveMap(pathname) < 0)
+            return 1;
+        uint64_t save= timer.stop();
+        size_t bytes= map_size(pathname, rmin, rmax);
+
+        timer.start();
+        World loaded;
+        if(loaded.loadMap(pathname) < 0)
+            return 1;
+        uint64_t load= timer.stop();
+
+        report("World::saveMap( )", save, regions * regions, (double) bytes);
+        report("World::loadMap( )", load, regions * regions, (double) bytes);
+        printf("  files %.2f MB\n", bytes / (1024.0 * 1024.0));
+
+        // meme monde au format version 1, celui des mondes existants
+        const std::string pathname_v1= "grid_perf_map_v1";
+        mkdir(pathname_v1.c_str(), 0755);
+        if(saveMap_v1(world, pathname_v1) < 0)
+            return 1;
+        size_t bytes_v1= map_size(pathname_v1, rmin, rmax);
+
+        timer.start();
+        World loaded_v1;
+        if(loaded_v1.loadMap(pathname_v1) < 0)
+            return 1;
+        uint64_t load_v1= timer.stop();
+
+        report("World::loadMap( ) v1", load_v1, regions * regions, (double) bytes_v1);
+        printf("  files v1 %.2f MB\n", bytes_v1 / (1024.0 * 1024.0));
+    }
+
+    // points de test
+    const long int n= 1 << 22;
+    std::vector<Gridpoint> points(n);
+    for(long int i= 0; i < n; i++)
+        points[i]= Gridpoint(rmin*256 + (int) (next() % (regions*256)), (int) (next() % 256), rmin*256 + (int) (next() % (regions*256)));
+
+    printf("\nacces aleatoires:\n");
+    {
+        long int sum= 0;
+        Timer timer;
+        for(long int i= 0; i < n; i++)
+        {
+            const Block *b= world.block(points[i]);
+            if(b != NULL)
+                sum+= b->voxel(points[i]);
+        }
+        report("World::block( )->voxel( )", timer.stop(), n);
+
+        long int check= 0;
+        timer.start();
+        for(long int i= 0; i < n; i++)
+            check+= world.voxel(points[i]);
+        report("World::voxel( )", timer.stop(), n);
+
+        GridCache cache;
+        timer.start();
+        for(long int i= 0; i < n; i++)
+            check+= world.voxel(points[i], cache);
+        report("World::voxel( cache )", timer.stop(), n);
+
+        if(2 * sum != check)
+            printf("  error: World::voxel() != Block::voxel()\n");
+    }
+
+    printf("\nacces coherents:\n");
+    {
+        // parcours des lignes de 256 voxels le long de z
+        long int sum= 0;
+        long int count= 0;
+        Timer timer;
+        for(long int i= 0; i < n / 256; i++)
+        {
+            Gridpoint p(points[i].x, points[i].y, rmin*256 + (int) (i % regions) * 256);
+            for(int z= 0; z < 256; z++, count++)
+            {
+                p.z++;
+                const Block *b= world.block(p);
+                if(b != NULL)
+                    sum+= b->voxel(p);
+            }
+        }
+        report("World::block( )->voxel( )", timer.stop(), count);
+
+        GridCache cache;
+        long int check= 0;
+        timer.start();
+        for(long int i= 0; i < n / 256; i++)
+        {
+            Gridpoint p(points[i].x, points[i].y, rmin*256 + (int) (i % regions) * 256);
+            for(int z= 0; z < 256; z++)
+            {
+                p.z++;
+                check+= world.voxel(p, cache);
+            }
+        }
+        report("World::voxel( cache )", timer.stop(), count);
+
+        if(sum != check)
+            printf("  error: World::voxel() != Block::voxel()\n");
+    }
+
+    printf("\nvoisins:\n");
+    {
+        // 6 voisins de chaque point
+        const long int m= n / 8;
+        Gridpoint neighbours[6];
+        int values[6];
+        long int sum= 0;
+        GridCache cache;
+        Timer timer;
+        for(long int i= 0; i < m; i++)
+        {
+            const Gridpoint& p= points[i];
+            neighbours[0]= Gridpoint(p.x -1, p.y, p.z);
+            neighbours[1]= Gridpoint(p.x +1, p.y, p.z);
+            neighbours[2]= Gridpoint(p.x, p.y -1, p.z);
+            neighbours[3]= Gridpoint(p.x, p.y +1, p.z);
+            neighbours[4]= Gridpoint(p.x, p.y, p.z -1);
+            neighbours[5]= Gridpoint(p.x, p.y, p.z +1);
+            world.voxels(neighbours, 6, values, cache);
+            for(int k= 0; k < 6; k++)
+                sum+= values[k];
+        }
+        report("World::voxels( 6 voisins )", timer.stop(), m * 6);
+
+        // parcours complet des blocks, 6 voisins de chaque voxel
+        long int count= 0;
+        timer.start();
+        for(unsigned int i= 0; i < blocks.size() && i < 256; i++)
+        {
+            const Gridpoint& pmin= blocks[i].bbox.pMin;
+            for(int y= 0; y < 16; y++)
+            for(int x= 0; x < 16; x++)
+            for(int z= 0; z < 16; z++, count+= 6)
+            {
+                Gridpoint p(pmin.x + x, pmin.y + y, pmin.z + z);
+                neighbours[0]= Gridpoint(p.x -1, p.y, p.z);
+                neighbours[1]= Gridpoint(p.x +1, p.y, p.z);
+                neighbours[2]= Gridpoint(p.x, p.y -1, p.z);
+                neighbours[3]= Gridpoint(p.x, p.y +1, p.z);
+                neighbours[4]= Gridpoint(p.x, p.y, p.z -1);
+                neighbours[5]= Gridpoint(p.x, p.y, p.z +1);
+                world.voxels(neighbours, 6, values, cache);
+                for(int k= 0; k < 6; k++)
+                    sum+= values[k];
+            }
+        }
+        report("World::voxels( block scan )", timer.stop(), count);
+
+        if(sum < 0)
+            printf("  error\n");
+    }
+
+    printf("\nmodifications:\n");
+    {
+        const long int m= n / 16;
+        Timer timer;
+        for(long int i= 0; i < m; i++)
+            world.set(points[i], (unsigned char) (next() % 8));
+        report("World::set( )", timer.stop(), m);
+        printf("  %u dirty blocks\n", (unsigned int) world.dirty.size());
+    }
+
+    printf("\nlancer de rayons:\n");
+    {
+        const long int m= n / 64;
+        long int hits= 0;
+        Timer timer;
+        for(long int i= 0; i < m; i++)
+        {
+            gk::Vec3 o(points[i].x + .5f, points[i].y + .5f, points[i].z + .5f);
+            gk::Vec3 d(uniform() * 2 -1, uniform() * 2 -1, uniform() * 2 -1);
+            GridHit hit;
+            if(world.intersect(o, d, 1024, hit))
+                hits++;
+        }
+        report("World::intersect( )", timer.stop(), m);
+        printf("  %ld hits\n", hits);
+    }
+
+    return 0;
+}
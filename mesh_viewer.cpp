@@ -16,6 +16,7 @@
 
 #include "Mesh.h"
 #include "MeshIO.h"
+#include "MeshOptimizer.h"
 
 #include "Orbiter.h"
 #include "OrbiterIO.h"
@@ -141,6 +142,11 @@ public:
         if(mesh == NULL)
             return -1;  // erreur de lecture
         
+        // 1 seul groupe de faces par matiere, 1 draw par matiere
+        gk::MeshIO::groupMaterials(mesh);
+        // reordonne les triangles et les sommets pour les caches du gpu
+        gk::MeshOptimizer::optimize(mesh);
+        
         //~ if(mesh->normals.size() != mesh->positions.size())
             //~ gk::MeshIO::buildNormals(mesh);     // construire les normales si necessaire.
         
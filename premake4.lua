@@ -104,3 +104,10 @@ end
 --	language "C++"
 --	kind "ConsoleApp"
 --	files { "mini_gl3core.cpp" }
+
+-- mesure des performances de la grille de voxels, sans affichage
+-- usage : grid_perf [regions par cote] [densite des blocks] [densite des voxels]
+project("grid_perf")
+	language "C++"
+	kind "ConsoleApp"
+	files { "grid_perf.cpp", "Grid.cpp", "Grid.h" }
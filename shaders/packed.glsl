@@ -0,0 +1,49 @@
+// sommets compresses, cf gk::MeshPacking et GLBasicMesh::createBuffer( std::vector<PackedVertex> )
+#version 330
+
+
+#ifdef VERTEX_SHADER
+    uniform mat4 mvpMatrix;
+    uniform mat4 normalMatrix;
+
+    uniform vec3 bbox_min;      // PackedMesh::bbox.pMin
+    uniform vec3 bbox_max;      // PackedMesh::bbox.pMax
+
+    layout (location= 0) in vec3 position;      // quantifiee, [0 1] dans la bbox
+    layout (location= 1) in vec2 texcoord;      // half float
+    layout (location= 2) in vec2 normal;        // encodage octaedrique, [-1 1]
+
+    out vec3 vertex_normal;
+    out vec2 vertex_texcoord;
+
+    vec3 decode_octahedral( const in vec2 e )
+    {
+        vec2 p= clamp(e, -1.0, 1.0);
+        vec3 n= vec3(p, 1.0 - abs(p.x) - abs(p.y));
+        float t= max(-n.z, 0.0);
+        n.x+= (n.x >= 0.0) ? -t : t;
+        n.y+= (n.y >= 0.0) ? -t : t;
+        return normalize(n);
+    }
+
+    void main( )
+    {
+        vec3 p= bbox_min + position * (bbox_max - bbox_min);
+        gl_Position= mvpMatrix * vec4(p, 1.0);
+        vertex_normal= mat3(normalMatrix) * decode_octahedral(normal);
+        vertex_texcoord= texcoord;
+    }
+#endif
+
+#ifdef FRAGMENT_SHADER
+    uniform vec4 color;
+
+    in vec3 vertex_normal;
+    in vec2 vertex_texcoord;
+    out vec4 fragment_color;
+
+    void main( )
+    {
+        fragment_color= color * abs(normalize(vertex_normal).z);
+    }
+#endif
@@ -13,6 +13,7 @@
 
 #include "Mesh.h"
 #include "Image.h"
+#include "ImageView.h"
 
 #include "MeshIO.h"
 #include "ImageIO.h"
@@ -255,10 +256,14 @@ int main( )
     // compose les transformations utiles
     gk::Transform vpv= viewport * projection * view;
     
+    // acces direct aux pixels de l'image, rgba float
+    gk::ImageView<float, 4> pixels(image);
+    
     // parcours tous les pixels de l'image
     for(int y= 0; y < image->height; y++)
     {
-        for(int x= 0; x < image->width; x++)
+        float *pixel= pixels.row(y);
+        for(int x= 0; x < image->width; x++, pixel+= 4)
         {
             // generer le rayon pour le pixel (x,y) dans le repere de l'image
             gk::Point origine(x +.5f, y + .5f, -1.f);    // sur le plan near
@@ -294,7 +299,10 @@ int main( )
             }
            
             // ecrire la couleur dans l'image
-            image->setPixel(x, y, gk::Color(color.r, color.g, color.b, 1.0f));
+            pixel[0]= color.r;
+            pixel[1]= color.g;
+            pixel[2]= color.b;
+            pixel[3]= 1.f;
         }
     }
    